@@ -84,6 +84,43 @@ int32_t ntz64(const uint64_t x) {
 	return n - ( xCpy & 0x0000000000000001 );
 }
 
+//number of leading zeros algorithm using binary search taken from Hacker's delight...
+int32_t nlz64(const uint64_t x) {
+	uint64_t xCpy = x;
+	int32_t n;
+
+	if( xCpy == 0 ) {
+		return 64;
+	}
+
+	n = 0;
+	if( xCpy <= 0x00000000FFFFFFFF ) {
+		n = n + 32;
+		xCpy = xCpy << 32;
+	}
+	if( xCpy <= 0x0000FFFFFFFFFFFF ) {
+		n = n + 16;
+		xCpy = xCpy << 16;
+	}
+	if( xCpy <= 0x00FFFFFFFFFFFFFF ) {
+		n = n + 8;
+		xCpy = xCpy << 8;
+	}
+	if( xCpy <= 0x0FFFFFFFFFFFFFFF ) {
+		n = n + 4;
+		xCpy = xCpy << 4;
+	}
+	if( xCpy <= 0x3FFFFFFFFFFFFFFF ) {
+		n = n + 2;
+		xCpy = xCpy << 2;
+	}
+	if( xCpy <= 0x7FFFFFFFFFFFFFFF ) {
+		n = n + 1;
+	}
+
+	return n;
+}
+
 int32_t pop32(const uint32_t x) {
 	uint32_t xCpy = x;
 
@@ -51,6 +51,12 @@ int32_t ntz32(const uint32_t x);
  Counts the number of trailing zeros of a 64 bit unsigned integer.*/
 int32_t ntz64(const uint64_t x);
 
+/*! \brief Number of leading zeros 64bits
+ \param const uint64_t x:   word
+ \return int32_t number of leading zeros
+ 
+ Counts the number of leading zeros of a 64 bit unsigned integer.*/
+int32_t nlz64(const uint64_t x);
 
 /*! \brief Number of 1-bits in a given 32 bit word
  \param const uint32_t x:   variable
@@ -0,0 +1,407 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*! \file hilbertBench.c
+ \brief Throughput benchmark for the Hilbert key encoding and decoding
+
+ Measures keys/s and ns/key for encoding (getHKeyFromIntCoord), decoding
+ (getIntCoordFromHKey) and comparing neighbouring points in Hilbert order
+ (compareHKeyFromIntCoord), called point by point and through the batched interface,
+ for all supported dimensions and a sweep of hilbert orders. Input points are either
+ uniformly distributed or clustered. Every configuration is run single threaded and
+ with the requested number of threads. Results are written as CSV or JSON to stdout.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "hilbertKey.h"
+#include "hilbertStats.h"
+
+#define BENCH_NUM_CLUSTERS 8
+//smallest cluster width in cells, so that low orders do not collapse to the cluster centers
+#define BENCH_MIN_CLUSTER_WIDTH 4
+
+static const int32_t benchOrders[] = {1, 2, 3, 4, 6, 8, 12, 16, 20, 24, 31};
+
+enum benchFormat { BENCH_CSV, BENCH_JSON };
+enum benchOp { BENCH_ENCODE, BENCH_DECODE, BENCH_COMPARE };
+enum benchMode { BENCH_SINGLE, BENCH_BATCH };
+enum benchDist { BENCH_UNIFORM, BENCH_CLUSTERED };
+
+static const char * opNames[] = {"encode", "decode", "compare"};
+static const char * modeNames[] = {"single", "batch"};
+static const char * distNames[] = {"uniform", "clustered"};
+
+typedef struct {
+	enum benchOp op;
+	enum benchMode mode;
+	int32_t m;
+	int32_t dim;
+	uint64_t numPoints;
+	const uint64_t * points;
+	const uint64_t * keys;
+	uint64_t * outKeys;
+	uint64_t * outCoords;
+	int32_t * outOrder;
+	uint64_t checksum;
+	int numReps;
+	pthread_barrier_t * barrier;
+} benchTask;
+
+//xorshift64* - cheap reproducible random numbers that do not share state between runs
+static uint64_t nextRandom(uint64_t * state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+static void fillPoints(uint64_t * points, const int32_t m, const int32_t dim, const uint64_t numPoints,
+						const enum benchDist dist, uint64_t seed) {
+	uint64_t state = seed;
+	uint64_t mask = ((uint64_t)1 << m) - 1;
+
+	if(dist == BENCH_UNIFORM) {
+		for(uint64_t i=0; i<numPoints * dim; i++) {
+			points[i] = nextRandom(&state) & mask;
+		}
+		return;
+	}
+
+	//clustered: points scattered around a couple of cluster centers with a width of 1/64 of the box,
+	//but at least a few cells (or the whole box at the lowest orders)
+	uint64_t centers[BENCH_NUM_CLUSTERS * HKEY_MAX_DIM];
+	for(int i=0; i<BENCH_NUM_CLUSTERS * dim; i++) {
+		centers[i] = nextRandom(&state) & mask;
+	}
+
+	int64_t width = (int64_t)((mask >> 6) + 1);
+	if(width < BENCH_MIN_CLUSTER_WIDTH) {
+		width = (int64_t)mask + 1 < BENCH_MIN_CLUSTER_WIDTH ? (int64_t)mask + 1 : BENCH_MIN_CLUSTER_WIDTH;
+	}
+	for(uint64_t i=0; i<numPoints; i++) {
+		uint64_t * center = &centers[(nextRandom(&state) % BENCH_NUM_CLUSTERS) * dim];
+		for(int j=0; j<dim; j++) {
+			//difference of two uniforms gives a symmetric triangular distribution around the center
+			int64_t offset = (int64_t)(nextRandom(&state) % width) - (int64_t)(nextRandom(&state) % width);
+			int64_t value = (int64_t)center[j] + offset;
+			if(value < 0) {
+				value = 0;
+			}
+			if(value > (int64_t)mask) {
+				value = (int64_t)mask;
+			}
+			points[i * dim + j] = (uint64_t)value;
+		}
+	}
+}
+
+static void * runTask(void * arg) {
+	benchTask * task = (benchTask*)arg;
+	uint64_t checksum = 0;
+	uint64_t coord[HKEY_MAX_DIM];
+	int err;
+
+	if(task->numPoints == 0) {
+		task->checksum = 0;
+		return NULL;
+	}
+
+	if(task->op == BENCH_ENCODE) {
+		if(task->mode == BENCH_SINGLE) {
+			for(uint64_t i=0; i<task->numPoints; i++) {
+				checksum += getHKeyFromIntCoord(task->m, task->dim, &task->points[i * task->dim], &err);
+			}
+		} else {
+			getHKeysFromIntCoords(task->outKeys, task->m, task->dim, task->numPoints, task->points, &err);
+			checksum += task->outKeys[task->numPoints - 1];
+		}
+	} else if(task->op == BENCH_DECODE) {
+		if(task->mode == BENCH_SINGLE) {
+			for(uint64_t i=0; i<task->numPoints; i++) {
+				//decode into a thread local array, a shared output array would measure false sharing
+				getIntCoordFromHKey(coord, task->m, task->dim, task->keys[i], &err);
+				checksum += coord[0];
+			}
+		} else {
+			getIntCoordsFromHKeys(task->outCoords, task->m, task->dim, task->numPoints, task->keys, &err);
+			checksum += task->outCoords[(task->numPoints - 1) * task->dim];
+		}
+	} else {
+		//every point is compared to the one following it
+		if(task->mode == BENCH_SINGLE) {
+			for(uint64_t i=0; i<task->numPoints; i++) {
+				checksum += compareHKeyFromIntCoord(task->m, task->dim, &task->points[i * task->dim],
+													&task->points[(i + 1) * task->dim], &err);
+			}
+		} else {
+			compareHKeysFromIntCoords(task->outOrder, task->m, task->dim, task->numPoints, task->points,
+										&task->points[task->dim], &err);
+			checksum += task->outOrder[task->numPoints - 1];
+		}
+	}
+
+	task->checksum = checksum;
+	return NULL;
+}
+
+//worker threads run all repetitions of their task between two barriers, so thread start-up is not timed
+static void * runWorker(void * arg) {
+	benchTask * task = (benchTask*)arg;
+
+	for(int r=0; r<task->numReps; r++) {
+		pthread_barrier_wait(task->barrier);
+		runTask(task);
+		pthread_barrier_wait(task->barrier);
+	}
+
+	return NULL;
+}
+
+//runs one configuration split over numThreads threads and returns the best wall clock time of all repetitions
+//numPoints is the number of items processed, comparisons need one point more than that. The calling
+//thread works on the first slice and takes the time between the start and end barrier.
+static double runBench(const enum benchOp op, const enum benchMode mode, const int32_t m, const int32_t dim,
+						const uint64_t numPoints, const uint64_t * points, const uint64_t * keys,
+						uint64_t * outKeys, uint64_t * outCoords, int32_t * outOrder, const int numThreads,
+						const int numReps, uint64_t * checksum) {
+	benchTask tasks[numThreads];
+	pthread_t threads[numThreads];
+	pthread_barrier_t barrier;
+	double best = -1.0;
+
+	uint64_t chunk = (numPoints + numThreads - 1) / numThreads;
+	for(int t=0; t<numThreads; t++) {
+		uint64_t start = t * chunk;
+		uint64_t end = start + chunk < numPoints ? start + chunk : numPoints;
+
+		tasks[t].op = op;
+		tasks[t].mode = mode;
+		tasks[t].m = m;
+		tasks[t].dim = dim;
+		tasks[t].numPoints = start < end ? end - start : 0;
+		tasks[t].points = &points[start * dim];
+		tasks[t].keys = &keys[start];
+		tasks[t].outKeys = &outKeys[start];
+		tasks[t].outOrder = &outOrder[start];
+		tasks[t].outCoords = &outCoords[start * dim];
+		tasks[t].numReps = numReps;
+		tasks[t].barrier = &barrier;
+	}
+
+	pthread_barrier_init(&barrier, NULL, numThreads);
+	for(int t=1; t<numThreads; t++) {
+		//the threads started so far would wait at the barrier forever
+		if(pthread_create(&threads[t], NULL, runWorker, &tasks[t]) != 0) {
+			fprintf(stderr, "Cannot start benchmark thread %i of %i\n", t + 1, numThreads);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for(int r=0; r<numReps; r++) {
+		pthread_barrier_wait(&barrier);
+		double tStart = now();
+
+		runTask(&tasks[0]);
+		pthread_barrier_wait(&barrier);
+
+		double elapsed = now() - tStart;
+		if(best < 0.0 || elapsed < best) {
+			best = elapsed;
+		}
+
+		for(int t=0; t<numThreads; t++) {
+			*checksum += tasks[t].checksum;
+		}
+	}
+
+	for(int t=1; t<numThreads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	pthread_barrier_destroy(&barrier);
+
+	return best;
+}
+
+static void printResult(const enum benchFormat format, const char * label, const int first,
+						const enum benchOp op, const enum benchMode mode, const enum benchDist dist,
+						const int32_t dim, const int32_t m, const int numThreads, const uint64_t numPoints,
+						const double seconds) {
+	double keysPerSec = (double)numPoints / seconds;
+	double nsPerKey = seconds * 1.0e9 / (double)numPoints;
+
+	if(format == BENCH_CSV) {
+		printf("%s,%s,%s,%s,%i,%i,%i,%llu,%.9f,%.1f,%.3f\n", label, opNames[op], modeNames[mode], distNames[dist],
+				dim, m, numThreads, (unsigned long long)numPoints, seconds, keysPerSec, nsPerKey);
+	} else {
+		printf("%s  {\"label\": \"%s\", \"op\": \"%s\", \"mode\": \"%s\", \"dist\": \"%s\", \"dim\": %i, \"m\": %i, "
+				"\"threads\": %i, \"n\": %llu, \"seconds\": %.9f, \"keys_per_s\": %.1f, \"ns_per_key\": %.3f}",
+				first ? "" : ",\n", label, opNames[op], modeNames[mode], distNames[dist], dim, m, numThreads,
+				(unsigned long long)numPoints, seconds, keysPerSec, nsPerKey);
+	}
+}
+
+static void usage(const char * name) {
+	fprintf(stderr, "Usage:\n %s [-f csv|json] [-n numPoints] [-t numThreads] [-r repetitions] [-d maxDim] [-l label]\n", name);
+}
+
+int main (int argc, char * const argv[]) {
+	enum benchFormat format = BENCH_CSV;
+	uint64_t numPoints = 1 << 18;
+	int numThreads = 4;
+	int numReps = 3;
+	int maxDim = HKEY_MAX_DIM;
+	const char * label = "libhilbert";
+
+	for(int i=1; i<argc; i++) {
+		if(i + 1 >= argc) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+
+		if(strcmp(argv[i], "-f") == 0) {
+			format = strcmp(argv[++i], "json") == 0 ? BENCH_JSON : BENCH_CSV;
+		} else if(strcmp(argv[i], "-n") == 0) {
+			numPoints = strtoull(argv[++i], NULL, 10);
+		} else if(strcmp(argv[i], "-t") == 0) {
+			numThreads = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-r") == 0) {
+			numReps = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-d") == 0) {
+			maxDim = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-l") == 0) {
+			label = argv[++i];
+		} else {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if(numPoints == 0 || numThreads < 1 || (uint64_t)numThreads > numPoints || numReps < 1 || maxDim < 1 || maxDim > HKEY_MAX_DIM) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	uint64_t * points = (uint64_t*)malloc(numPoints * HKEY_MAX_DIM * sizeof(uint64_t));
+	uint64_t * keys = (uint64_t*)malloc(numPoints * sizeof(uint64_t));
+	uint64_t * outKeys = (uint64_t*)malloc(numPoints * sizeof(uint64_t));
+	uint64_t * outCoords = (uint64_t*)malloc(numPoints * HKEY_MAX_DIM * sizeof(uint64_t));
+	int32_t * outOrder = (int32_t*)malloc(numPoints * sizeof(int32_t));
+	if(points == NULL || keys == NULL || outKeys == NULL || outCoords == NULL || outOrder == NULL) {
+		fprintf(stderr, "Not enough memory for %llu points\n", (unsigned long long)numPoints);
+		exit(EXIT_FAILURE);
+	}
+
+	int threadCounts[2] = {1, numThreads};
+	int numThreadCounts = numThreads > 1 ? 2 : 1;
+	uint64_t checksum = 0;
+	int first = 1;
+
+	if(format == BENCH_CSV) {
+		printf("label,op,mode,dist,dim,m,threads,n,seconds,keys_per_s,ns_per_key\n");
+	} else {
+		printf("[\n");
+	}
+
+	for(int32_t dim=1; dim<=maxDim; dim++) {
+		for(size_t o=0; o<sizeof(benchOrders) / sizeof(benchOrders[0]); o++) {
+			int32_t m = benchOrders[o];
+
+			//keys are 64 bit wide
+			if(m * dim > 64) {
+				continue;
+			}
+
+			for(int d=BENCH_UNIFORM; d<=BENCH_CLUSTERED; d++) {
+				int err;
+
+				fillPoints(points, m, dim, numPoints, (enum benchDist)d, 0x9E3779B97F4A7C15ULL + dim * 64 + m);
+				getHKeysFromIntCoords(keys, m, dim, numPoints, points, &err);
+
+				for(int op=BENCH_ENCODE; op<=BENCH_COMPARE; op++) {
+					uint64_t numItems = op == BENCH_COMPARE ? numPoints - 1 : numPoints;
+
+					if(numItems < (uint64_t)numThreads) {
+						continue;
+					}
+
+					for(int mode=BENCH_SINGLE; mode<=BENCH_BATCH; mode++) {
+						for(int t=0; t<numThreadCounts; t++) {
+							double seconds = runBench((enum benchOp)op, (enum benchMode)mode, m, dim, numItems,
+														points, keys, outKeys, outCoords, outOrder,
+														threadCounts[t], numReps, &checksum);
+
+							printResult(format, label, first, (enum benchOp)op, (enum benchMode)mode,
+										(enum benchDist)d, dim, m, threadCounts[t], numItems, seconds);
+							first = 0;
+						}
+					}
+				}
+			}
+
+			fflush(stdout);
+		}
+	}
+
+	if(format == BENCH_JSON) {
+		printf("\n]\n");
+	}
+
+	//print the checksum to stderr so the compiler cannot drop the benchmarked calls
+	fprintf(stderr, "checksum: %llu\n", (unsigned long long)checksum);
+
+	if(hkeyStatsEnabled()) {
+		hkeyStats stats;
+		hkeyStatsSnapshot(&stats);
+		fprintf(stderr, "stats: encodeCalls=%llu batchEncodeCalls=%llu pointsEncoded=%llu decodeCalls=%llu "
+				"batchDecodeCalls=%llu keysDecoded=%llu clampedCoords=%llu dimErrors=%llu\n",
+				(unsigned long long)stats.encodeCalls, (unsigned long long)stats.batchEncodeCalls,
+				(unsigned long long)stats.pointsEncoded, (unsigned long long)stats.decodeCalls,
+				(unsigned long long)stats.batchDecodeCalls, (unsigned long long)stats.keysDecoded,
+				(unsigned long long)stats.clampedCoords, (unsigned long long)stats.dimErrors);
+
+		//average number of levels a comparison walks, i.e. the common prefix length plus one (one for equal points)
+		fprintf(stderr, "stats: compareCalls=%llu batchCompareCalls=%llu pairsCompared=%llu compareLevels=%llu "
+				"levelsPerCompare=%.3f\n",
+				(unsigned long long)stats.compareCalls, (unsigned long long)stats.batchCompareCalls,
+				(unsigned long long)stats.pairsCompared, (unsigned long long)stats.compareLevels,
+				stats.pairsCompared > 0 ? (double)stats.compareLevels / (double)stats.pairsCompared : 0.0);
+	}
+
+	free(points);
+	free(keys);
+	free(outKeys);
+	free(outCoords);
+	free(outOrder);
+
+    return EXIT_SUCCESS;
+}
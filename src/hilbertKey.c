@@ -20,13 +20,24 @@
 #include "hilbertKey.h"
 #include "N10.h"
 #include "binaryOps.h"
+#include "hilbertStats.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 
+#if HKEY_MAX_DIM != HILB_MAX_DIM
+#error "HKEY_MAX_DIM in hilbertKey.h needs to match the dimensions of the gene tables"
+#endif
+
 uint64_t getHKeyFromCoord( const int32_t m, const double boxSize, const int32_t dim, const double * point, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return 0;
+	}
+
 	double boxConv = (double)powf(2.0, m) / boxSize;
 
 	//calculate integer values of scaled point to the box coordinate system
@@ -41,18 +52,14 @@ uint64_t getHKeyFromCoord( const int32_t m, const double boxSize, const int32_t
 	return getHKeyFromIntCoord(m, dim, iPoint, err);
 }
 
-uint64_t getHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t * point, int * err ) {
+//encoding kernel shared by the single point and batched interface - dim needs to be checked by the caller
+static uint64_t hilbertEncode( const int32_t m, const int32_t dim, const uint64_t * point ) {
 	uint64_t result = 0;
-	uint64_t TwoPowerOfM = 1 << m;
+	uint64_t TwoPowerOfM = (uint64_t)1 << m;
 
 	uint64_t tmpPoint[dim];
 	uint64_t tmp[dim];
 
-	if( dim > HILB_MAX_DIM ) {
-		*err = HKEY_ERR_DIM;
-		return 0;
-	}
-
 	//check data sanity
 	for(int i=0; i<dim; i++) {
 		assert(point[i] >= 0);
@@ -63,8 +70,9 @@ uint64_t getHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t
 
 	//clamp larger values to highest possible space on hilbert curve...
 	for(int i=0; i<dim; i++) {
-		if(tmpPoint[i] > TwoPowerOfM) {
+		if(tmpPoint[i] >= TwoPowerOfM) {
 			tmpPoint[i] = TwoPowerOfM - 1;
+			HKEY_STATS_ADD(clampedCoords, 1);
 		}
 	}
 
@@ -173,20 +181,35 @@ uint64_t getHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t
 	printf("End result = %llu\n", result);
 #endif
 
-	*err = HKEY_ERR_OK;
 	return result;
 }
 
-void getCoordFromHKey( double * outCoord, const int32_t m, const double boxSize, const int32_t dim, const uint64_t key, int * err ) {
-	double boxConv = (double)powf(2.0, m) / boxSize;
+uint64_t getHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t * point, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return 0;
+	}
+
+	HKEY_STATS_ADD(encodeCalls, 1);
+	HKEY_STATS_ADD(pointsEncoded, 1);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+
+	*err = HKEY_ERR_OK;
+	return hilbertEncode(m, dim, point);
+}
 
-	//allocate integer array
-	uint64_t * result = (uint64_t*)malloc(dim * sizeof(uint64_t));
-	if(result == NULL) {
-		*err = HKEY_ERR_NOMEM;
+void getCoordFromHKey( double * outCoord, const int32_t m, const double boxSize, const int32_t dim, const uint64_t key, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
 		return;
 	}
-	memset(result, 0, dim * sizeof(uint64_t));
+
+	double boxConv = (double)powf(2.0, m) / boxSize;
+
+	//integer coordinates along the hilbert curve
+	uint64_t result[dim];
 
 	getIntCoordFromHKey(result, m, dim, key, err);
 
@@ -198,13 +221,12 @@ void getCoordFromHKey( double * outCoord, const int32_t m, const double boxSize,
 		outCoord[i] = result[i] / boxConv;
 	}
 
-	free(result);
-
 	*err = HKEY_ERR_OK;
 	return;
 }
 
-void getIntCoordFromHKey( uint64_t * outCoord, const int32_t m, const int32_t dim, const uint64_t key, int * err ) {
+//decoding kernel shared by the single key and batched interface - dim needs to be checked by the caller
+static void hilbertDecode( uint64_t * outCoord, const int32_t m, const int32_t dim, const uint64_t key ) {
 	uint64_t tmpKey = key;
 	uint64_t flip = 0;
 
@@ -306,7 +328,418 @@ void getIntCoordFromHKey( uint64_t * outCoord, const int32_t m, const int32_t di
 #endif			
 		}
 	}
+}
+
+void getIntCoordFromHKey( uint64_t * outCoord, const int32_t m, const int32_t dim, const uint64_t key, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return;
+	}
+
+	HKEY_STATS_ADD(decodeCalls, 1);
+	HKEY_STATS_ADD(keysDecoded, 1);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+
+	hilbertDecode(outCoord, m, dim, key);
+
+	*err = HKEY_ERR_OK;
+	return;
+}
+
+void getHKeysFromIntCoords( uint64_t * outKeys, const int32_t m, const int32_t dim, const uint64_t numPoints, const uint64_t * points, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return;
+	}
+
+	HKEY_STATS_ADD(batchEncodeCalls, 1);
+	HKEY_STATS_ADD(pointsEncoded, numPoints);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+	HKEY_STATS_TIMER_START(tStart);
+
+	for(uint64_t i=0; i<numPoints; i++) {
+		outKeys[i] = hilbertEncode(m, dim, &points[i * dim]);
+	}
+
+	HKEY_STATS_TIMER_STOP(tStart, HKEY_STATS_OP_ENCODE, dim, numPoints);
+
+	*err = HKEY_ERR_OK;
+	return;
+}
+
+void getIntCoordsFromHKeys( uint64_t * outCoords, const int32_t m, const int32_t dim, const uint64_t numKeys, const uint64_t * keys, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return;
+	}
+
+	HKEY_STATS_ADD(batchDecodeCalls, 1);
+	HKEY_STATS_ADD(keysDecoded, numKeys);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+	HKEY_STATS_TIMER_START(tStart);
+
+	for(uint64_t i=0; i<numKeys; i++) {
+		hilbertDecode(&outCoords[i * dim], m, dim, keys[i]);
+	}
+
+	HKEY_STATS_TIMER_STOP(tStart, HKEY_STATS_OP_DECODE, dim, numKeys);
+
+	*err = HKEY_ERR_OK;
+	return;
+}
+
+//follows the orientation of the curve into the subcube hOrder. The orientation is kept as a permutation
+//of the dimensions (perm[j]: dimension of the point at position j) and a mask of reversed positions.
+static void hilbertOrient( const int32_t dim, const uint64_t hOrder, int32_t * perm, uint64_t * flip ) {
+	uint32_t * currH = H[dim-1];
+	int64_t exchange_gene = currH[hOrder * 2 + 0];
+	int64_t reverse_gene = currH[hOrder * 2 + 1];
+	uint64_t exDim1 = exchange_gene & (-1 * exchange_gene);
+	uint64_t exDim2 = (uint64_t)exchange_gene ^ exDim1;
+
+	//reverse first, then exchange - same order as in the encoder
+	*flip ^= (uint64_t)reverse_gene;
+
+	if(exDim1 != 0 && exDim2 != 0) {
+		int32_t dimIdx1 = ntz64(exDim1);
+		int32_t dimIdx2 = ntz64(exDim2);
+
+		assert(dimIdx1 < dim);
+		assert(dimIdx2 < dim);
+
+		int32_t tmp = perm[dimIdx1];
+		perm[dimIdx1] = perm[dimIdx2];
+		perm[dimIdx2] = tmp;
+
+		//the reverse flags travel with the exchanged dimensions
+		if(((*flip >> dimIdx1) & 1) != ((*flip >> dimIdx2) & 1)) {
+			*flip ^= exDim1 | exDim2;
+		}
+	}
+}
+
+//comparison kernel shared by the single pair and batched interface - dim needs to be checked by the caller
+static int32_t hilbertCompare( const int32_t m, const int32_t dim, const uint64_t * pointA, const uint64_t * pointB ) {
+	uint64_t TwoPowerOfM = (uint64_t)1 << m;
+	uint64_t tmpA[dim];
+	uint64_t tmpB[dim];
+	uint64_t diff = 0;
+
+	//clamp like the encoder does and find the bits in which the two points differ
+	for(int i=0; i<dim; i++) {
+		tmpA[i] = pointA[i] < TwoPowerOfM ? pointA[i] : TwoPowerOfM - 1;
+		tmpB[i] = pointB[i] < TwoPowerOfM ? pointB[i] : TwoPowerOfM - 1;
+		diff |= tmpA[i] ^ tmpB[i];
+	}
+
+	//equal points count as one level, so that levels per comparison reflect the cost of all pairs
+	if(diff == 0) {
+		HKEY_STATS_ADD(compareLevels, 1);
+		return 0;
+	}
+
+	//reverse and exchange operations act on both points alike, so the first level at which the
+	//subcubes differ is given by the highest differing bit. Above it, only the orientation of the
+	//curve needs to be followed instead of transforming the coordinates themselves.
+	int32_t divergeBit = 63 - nlz64(diff);
+	int32_t perm[dim];
+	uint64_t flip = 0;
+
+	for(int i=0; i<dim; i++) {
+		perm[i] = i;
+	}
+
+	uint32_t * currRevC = revC[dim-1];
+
+	for(int32_t bit=m-1; bit>divergeBit; bit--) {
+		uint64_t upperBitsOfPoint = 0;
+		for(int j=0; j<dim; j++) {
+			upperBitsOfPoint += IBITS(tmpA[perm[j]], bit, 1) << j;
+		}
+		upperBitsOfPoint ^= flip;
+
+		hilbertOrient(dim, currRevC[upperBitsOfPoint], perm, &flip);
+	}
+
+	HKEY_STATS_ADD(compareLevels, m - divergeBit);
+
+	uint64_t upperBitsA = 0;
+	uint64_t upperBitsB = 0;
+	for(int j=0; j<dim; j++) {
+		upperBitsA += IBITS(tmpA[perm[j]], divergeBit, 1) << j;
+		upperBitsB += IBITS(tmpB[perm[j]], divergeBit, 1) << j;
+	}
+
+	return currRevC[upperBitsA ^ flip] < currRevC[upperBitsB ^ flip] ? -1 : 1;
+}
+
+int32_t compareHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t * pointA, const uint64_t * pointB, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return 0;
+	}
+
+	//the clamp needs 2**m to fit into 64 bits
+	if( m < 0 || m > 63 ) {
+		*err = HKEY_ERR_PARAM;
+		return 0;
+	}
+
+	HKEY_STATS_ADD(compareCalls, 1);
+	HKEY_STATS_ADD(pairsCompared, 1);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+
+	*err = HKEY_ERR_OK;
+	return hilbertCompare(m, dim, pointA, pointB);
+}
+
+void compareHKeysFromIntCoords( int32_t * outOrder, const int32_t m, const int32_t dim, const uint64_t numPairs, const uint64_t * pointsA, const uint64_t * pointsB, int * err ) {
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		HKEY_STATS_ADD(dimErrors, 1);
+		*err = HKEY_ERR_DIM;
+		return;
+	}
+
+	if( m < 0 || m > 63 ) {
+		*err = HKEY_ERR_PARAM;
+		return;
+	}
+
+	HKEY_STATS_ADD(batchCompareCalls, 1);
+	HKEY_STATS_ADD(pairsCompared, numPairs);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+	HKEY_STATS_TIMER_START(tStart);
+
+	for(uint64_t i=0; i<numPairs; i++) {
+		outOrder[i] = hilbertCompare(m, dim, &pointsA[i * dim], &pointsB[i * dim]);
+	}
+
+	HKEY_STATS_TIMER_STOP(tStart, HKEY_STATS_OP_COMPARE, dim, numPairs);
 
 	*err = HKEY_ERR_OK;
 	return;
-}
\ No newline at end of file
+}
+
+//checks the dimension and per dimension orders of compact keys, returns the largest order in maxM
+static int checkCompactOrders( const int32_t * m, const int32_t dim, int32_t * maxM ) {
+	int32_t sumM = 0;
+
+	if( dim < 1 || dim > HILB_MAX_DIM ) {
+		return HKEY_ERR_DIM;
+	}
+
+	*maxM = 0;
+	for(int i=0; i<dim; i++) {
+		if(m[i] < 0 || m[i] > 64) {
+			return HKEY_ERR_PARAM;
+		}
+		sumM += m[i];
+		if(m[i] > *maxM) {
+			*maxM = m[i];
+		}
+	}
+
+	if(sumM > 64) {
+		return HKEY_ERR_PARAM;
+	}
+
+	return HKEY_ERR_OK;
+}
+
+//positions of the (permuted) dimensions that still have bits at the given level
+static uint64_t compactActiveMask( const int32_t * m, const int32_t dim, const int32_t * perm, const int32_t bit ) {
+	uint64_t active = 0;
+
+	for(int j=0; j<dim; j++) {
+		if(m[perm[j]] > bit) {
+			active |= (uint64_t)1 << j;
+		}
+	}
+
+	return active;
+}
+
+//compact encoding kernel shared by the single point and batched interface - orders need to be checked by the caller
+//
+//The H-order of a level is the inverse gray code of the (transformed) upper bits of the point. Dimensions
+//without bits at this level always contribute the same gray code bit, thus the H-orders of all subcubes
+//that can be reached only differ in the bits at the positions of the active dimensions. Storing only these
+//bits keeps the order of the keys (gray code rank, see Hamilton & Rau-Chaplin 2008).
+static uint64_t hilbertCompactEncode( const int32_t * m, const int32_t dim, const int32_t maxM, const uint64_t * point ) {
+	uint64_t result = 0;
+	uint64_t tmpPoint[dim];
+	int32_t perm[dim];
+	uint64_t flip = 0;
+
+	//clamp larger values to highest possible space on hilbert curve...
+	for(int i=0; i<dim; i++) {
+		uint64_t maxCoord = m[i] < 64 ? ((uint64_t)1 << m[i]) - 1 : 0xFFFFFFFFFFFFFFFF;
+
+		tmpPoint[i] = point[i];
+		if(tmpPoint[i] > maxCoord) {
+			tmpPoint[i] = maxCoord;
+			HKEY_STATS_ADD(clampedCoords, 1);
+		}
+		perm[i] = i;
+	}
+
+	uint32_t * currRevC = revC[dim-1];
+
+	for(int32_t bit=maxM-1; bit>=0; bit--) {
+		uint64_t upperBitsOfPoint = 0;
+		for(int j=0; j<dim; j++) {
+			upperBitsOfPoint += IBITS(tmpPoint[perm[j]], bit, 1) << j;
+		}
+		upperBitsOfPoint ^= flip;
+
+		uint64_t hOrder = currRevC[upperBitsOfPoint];
+		uint64_t active = compactActiveMask(m, dim, perm, bit);
+
+		//append the H-order bits of the active dimensions, highest position first
+		for(int j=dim-1; j>=0; j--) {
+			if((active >> j) & 1) {
+				result = (result << 1) | ((hOrder >> j) & 1);
+			}
+		}
+
+		hilbertOrient(dim, hOrder, perm, &flip);
+	}
+
+	return result;
+}
+
+//compact decoding kernel shared by the single key and batched interface - orders need to be checked by the caller
+static void hilbertCompactDecode( uint64_t * outCoord, const int32_t * m, const int32_t dim, const int32_t maxM, const uint64_t key ) {
+	int32_t perm[dim];
+	uint64_t flip = 0;
+	int32_t pos = 0;
+
+	for(int i=0; i<dim; i++) {
+		outCoord[i] = 0;
+		perm[i] = i;
+		pos += m[i];
+	}
+
+	uint32_t * currC = C[dim-1];
+
+	for(int32_t bit=maxM-1; bit>=0; bit--) {
+		uint64_t active = compactActiveMask(m, dim, perm, bit);
+		int32_t numActive = pop64(active);
+
+		pos -= numActive;
+		uint64_t rank = numActive > 0 ? (key >> pos) & (((uint64_t)1 << numActive) - 1) : 0;
+
+		//rebuild the H-order from the highest position down: active positions come from the key,
+		//inactive ones follow from their fixed gray code bit (g_j = h_j ^ h_j+1), which is the reverse flag
+		uint64_t hOrder = 0;
+		uint64_t higherBit = 0;
+		for(int j=dim-1; j>=0; j--) {
+			uint64_t hBit;
+			if((active >> j) & 1) {
+				hBit = (rank >> --numActive) & 1;
+			} else {
+				hBit = ((flip >> j) & 1) ^ higherBit;
+			}
+			hOrder |= hBit << j;
+			higherBit = hBit;
+		}
+
+		uint64_t upperBitsOfPoint = currC[hOrder] ^ flip;
+		for(int j=0; j<dim; j++) {
+			if((active >> j) & 1) {
+				outCoord[perm[j]] |= IBITS(upperBitsOfPoint, j, 1) << bit;
+			}
+		}
+
+		hilbertOrient(dim, hOrder, perm, &flip);
+	}
+}
+
+uint64_t getCompactHKeyFromIntCoord( const int32_t * m, const int32_t dim, const uint64_t * point, int * err ) {
+	int32_t maxM;
+
+	*err = checkCompactOrders(m, dim, &maxM);
+	if(*err != HKEY_ERR_OK) {
+		if(*err == HKEY_ERR_DIM) {
+			HKEY_STATS_ADD(dimErrors, 1);
+		}
+		return 0;
+	}
+
+	HKEY_STATS_ADD(encodeCalls, 1);
+	HKEY_STATS_ADD(pointsEncoded, 1);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+
+	return hilbertCompactEncode(m, dim, maxM, point);
+}
+
+void getIntCoordFromCompactHKey( uint64_t * outCoord, const int32_t * m, const int32_t dim, const uint64_t key, int * err ) {
+	int32_t maxM;
+
+	*err = checkCompactOrders(m, dim, &maxM);
+	if(*err != HKEY_ERR_OK) {
+		if(*err == HKEY_ERR_DIM) {
+			HKEY_STATS_ADD(dimErrors, 1);
+		}
+		return;
+	}
+
+	HKEY_STATS_ADD(decodeCalls, 1);
+	HKEY_STATS_ADD(keysDecoded, 1);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+
+	hilbertCompactDecode(outCoord, m, dim, maxM, key);
+	return;
+}
+
+void getCompactHKeysFromIntCoords( uint64_t * outKeys, const int32_t * m, const int32_t dim, const uint64_t numPoints, const uint64_t * points, int * err ) {
+	int32_t maxM;
+
+	*err = checkCompactOrders(m, dim, &maxM);
+	if(*err != HKEY_ERR_OK) {
+		if(*err == HKEY_ERR_DIM) {
+			HKEY_STATS_ADD(dimErrors, 1);
+		}
+		return;
+	}
+
+	HKEY_STATS_ADD(batchEncodeCalls, 1);
+	HKEY_STATS_ADD(pointsEncoded, numPoints);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+	HKEY_STATS_TIMER_START(tStart);
+
+	for(uint64_t i=0; i<numPoints; i++) {
+		outKeys[i] = hilbertCompactEncode(m, dim, maxM, &points[i * dim]);
+	}
+
+	HKEY_STATS_TIMER_STOP(tStart, HKEY_STATS_OP_ENCODE, dim, numPoints);
+	return;
+}
+
+void getIntCoordsFromCompactHKeys( uint64_t * outCoords, const int32_t * m, const int32_t dim, const uint64_t numKeys, const uint64_t * keys, int * err ) {
+	int32_t maxM;
+
+	*err = checkCompactOrders(m, dim, &maxM);
+	if(*err != HKEY_ERR_OK) {
+		if(*err == HKEY_ERR_DIM) {
+			HKEY_STATS_ADD(dimErrors, 1);
+		}
+		return;
+	}
+
+	HKEY_STATS_ADD(batchDecodeCalls, 1);
+	HKEY_STATS_ADD(keysDecoded, numKeys);
+	HKEY_STATS_ADD(kernelCalls[dim-1], 1);
+	HKEY_STATS_TIMER_START(tStart);
+
+	for(uint64_t i=0; i<numKeys; i++) {
+		hilbertCompactDecode(&outCoords[i * dim], m, dim, maxM, keys[i]);
+	}
+
+	HKEY_STATS_TIMER_STOP(tStart, HKEY_STATS_OP_DECODE, dim, numKeys);
+	return;
+}
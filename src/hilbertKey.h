@@ -30,10 +30,17 @@
 #ifndef __CLASS_HILBKEY__
 #define __CLASS_HILBKEY__
 
+#define HKEY_ERR_PARAM -4
+#define HKEY_ERR_IO    -3
 #define HKEY_ERR_DIM   -2 
 #define HKEY_ERR_NOMEM -1
 #define HKEY_ERR_OK     0
 
+/*! \brief largest number of dimensions supported by the gene tables compiled into the library
+ 
+ Needs to follow HILB_MAX_DIM when the gene tables are regenerated for more dimensions.*/
+#define HKEY_MAX_DIM 10
+
 /*! \brief calculate hilbert key from given coordinates in box coordinates (doubles)
  \param const int32_t m:   		hilbert order (max integer dimension: 2**m cells)
  \param const double boxSize:   size of the box for coordinate renormalisation
@@ -55,7 +62,7 @@ uint64_t getHKeyFromCoord( const int32_t m, const double boxSize, const int32_t
  \return uint64_t hilbert key
  
  Calculates the Hilbert key from coordinates given in coordinates (int) along the hilbert. 
- curve. If coordinates are larger or smaller 0/2**m, they will clamp to 0/2**m.*/
+ curve. If coordinates are larger or equal 2**m, they will clamp to 2**m - 1.*/
 uint64_t getHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t * point, int * err );
 
 /*! \brief calculate coordinates in box system from a hiven Hilbert key
@@ -83,4 +90,107 @@ void getCoordFromHKey( double * outCoord, const int32_t m, const double boxSize,
  Result array for the coordinates needs to be allocated before calling this function!*/
 void getIntCoordFromHKey( uint64_t * outCoord, const int32_t m, const int32_t dim, const uint64_t key, int * err );
 
+/*! \brief calculate hilbert keys for an array of points in coordinates along the hilbert curve
+ \param uint64_t * outKeys:		pre-allocated array of size numPoints for the keys output
+ \param const int32_t m:   		hilbert order (max integer dimension: 2**m cells)
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t numPoints: number of points
+ \param const uint64_t * points: array of size numPoints * dim with the coordinates of the points (point after point)
+ \param int * err:   			output variable for error handling
+ 
+ Batched version of getHKeyFromIntCoord. The dimension is checked once for the whole batch.
+ Result array for the keys needs to be allocated before calling this function!*/
+void getHKeysFromIntCoords( uint64_t * outKeys, const int32_t m, const int32_t dim, const uint64_t numPoints, const uint64_t * points, int * err );
+
+/*! \brief calculate coordinates along the hilbert curve for an array of Hilbert keys
+ \param uint64_t * outCoords:	pre-allocated array of size numKeys * dim for coordinates output
+ \param const int32_t m:   		hilbert order (max integer dimension: 2**m cells)
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t numKeys: 	number of keys
+ \param const uint64_t * keys: 	array of size numKeys with hilbert keys
+ \param int * err:   			output variable for error handling
+ 
+ Batched version of getIntCoordFromHKey. The dimension is checked once for the whole batch.
+ Result array for the coordinates needs to be allocated before calling this function!*/
+void getIntCoordsFromHKeys( uint64_t * outCoords, const int32_t m, const int32_t dim, const uint64_t numKeys, const uint64_t * keys, int * err );
+
+/*! \brief compare two points by their position along the hilbert curve
+ \param const int32_t m:   		hilbert order (max integer dimension: 2**m cells)
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t * pointA: array of size dim with coordinates of the first point along hilbert curve
+ \param const uint64_t * pointB: array of size dim with coordinates of the second point along hilbert curve
+ \param int * err:   			output variable for error handling
+ \return int32_t -1, 0 or 1 if the key of pointA is smaller, equal or larger than the key of pointB
+ 
+ Gives the same result as comparing the keys of getHKeyFromIntCoord without calculating them.
+ The gene tables are only walked down to the first level at which the two points fall into
+ different subcubes, so the cost is proportional to the length of their common key prefix.
+ Coordinates are clamped like in getHKeyFromIntCoord. m needs to be between 0 and 63, and m * dim
+ at most 64 for the result to match the order of the keys. Returns HKEY_ERR_PARAM for other m.*/
+int32_t compareHKeyFromIntCoord( const int32_t m, const int32_t dim, const uint64_t * pointA, const uint64_t * pointB, int * err );
+
+/*! \brief compare pairs of points by their position along the hilbert curve
+ \param int32_t * outOrder:		pre-allocated array of size numPairs for the comparison results (-1, 0, 1)
+ \param const int32_t m:   		hilbert order (max integer dimension: 2**m cells)
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t numPairs: number of point pairs
+ \param const uint64_t * pointsA: array of size numPairs * dim with the first point of every pair
+ \param const uint64_t * pointsB: array of size numPairs * dim with the second point of every pair
+ \param int * err:   			output variable for error handling
+ 
+ Batched version of compareHKeyFromIntCoord, i.e. for one stage of a sorting network. Valid
+ orders are the same as for compareHKeyFromIntCoord.
+ Result array needs to be allocated before calling this function!*/
+void compareHKeysFromIntCoords( int32_t * outOrder, const int32_t m, const int32_t dim, const uint64_t numPairs, const uint64_t * pointsA, const uint64_t * pointsB, int * err );
+
+/*! \brief calculate a compact hilbert key with a different hilbert order per dimension
+ \param const int32_t * m:   	array of size dim with the hilbert order of every dimension (2**m[i] cells along dimension i)
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t * point: array of size dim with coordinates of a given point (0 <= point[i] < 2**m[i])
+ \param int * err:   			output variable for error handling
+ \return uint64_t compact hilbert key
+ 
+ Calculates the compact Hilbert key (Hamilton & Rau-Chaplin 2008) of a point in a grid with
+ 2**m[i] cells along dimension i. The key has exactly sum(m[i]) bits, which needs to be 64 or
+ less. At every level of the curve only the bits of the dimensions that still have bits at that
+ level are stored. Compact keys are ordered like the keys of getHKeyFromIntCoord with
+ m = max(m[i]) and reduce to them if all m[i] are equal. Coordinates larger or equal 2**m[i]
+ are clamped to 2**m[i] - 1. Returns HKEY_ERR_PARAM if the orders do not fit into 64 bits.*/
+uint64_t getCompactHKeyFromIntCoord( const int32_t * m, const int32_t dim, const uint64_t * point, int * err );
+
+/*! \brief calculate coordinates from a compact Hilbert key
+ \param uint64_t * outCoord: 	pre-allocated array for coordinates output
+ \param const int32_t * m:   	array of size dim with the hilbert order of every dimension
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t key: 	compact hilbert key
+ \param int * err:   			output variable for error handling
+ 
+ Inverse of getCompactHKeyFromIntCoord.
+ Result array for the coordinates needs to be allocated before calling this function!*/
+void getIntCoordFromCompactHKey( uint64_t * outCoord, const int32_t * m, const int32_t dim, const uint64_t key, int * err );
+
+/*! \brief calculate compact hilbert keys for an array of points
+ \param uint64_t * outKeys:		pre-allocated array of size numPoints for the keys output
+ \param const int32_t * m:   	array of size dim with the hilbert order of every dimension
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t numPoints: number of points
+ \param const uint64_t * points: array of size numPoints * dim with the coordinates of the points (point after point)
+ \param int * err:   			output variable for error handling
+ 
+ Batched version of getCompactHKeyFromIntCoord. The orders are checked once for the whole batch.
+ Result array for the keys needs to be allocated before calling this function!*/
+void getCompactHKeysFromIntCoords( uint64_t * outKeys, const int32_t * m, const int32_t dim, const uint64_t numPoints, const uint64_t * points, int * err );
+
+/*! \brief calculate coordinates for an array of compact Hilbert keys
+ \param uint64_t * outCoords:	pre-allocated array of size numKeys * dim for coordinates output
+ \param const int32_t * m:   	array of size dim with the hilbert order of every dimension
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t numKeys: 	number of keys
+ \param const uint64_t * keys: 	array of size numKeys with compact hilbert keys
+ \param int * err:   			output variable for error handling
+ 
+ Batched version of getIntCoordFromCompactHKey. The orders are checked once for the whole batch.
+ Result array for the coordinates needs to be allocated before calling this function!*/
+void getIntCoordsFromCompactHKeys( uint64_t * outCoords, const int32_t * m, const int32_t dim, const uint64_t numKeys, const uint64_t * keys, int * err );
+
 #endif
@@ -0,0 +1,272 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*! \file hilbertKeyCheck.c
+ \brief Randomized consistency check for the Hilbert key functions
+
+ Compares compareHKeyFromIntCoord and compareHKeysFromIntCoords with the order of the keys
+ of getHKeyFromIntCoord on random point pairs for all dimensions and orders that fit into
+ a 64 bit key. Compact keys are checked on random anisotropic grids: points and keys need to
+ round trip, compact keys need to be ordered like the keys of getHKeyFromIntCoord at the
+ largest order and equal them if all orders are the same. Exits with a non zero status on failure.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "hilbertKey.h"
+
+#define HKEY_CHECK_PAIRS 2000
+#define HKEY_CHECK_GRIDS 5000
+#define HKEY_CHECK_GRID_POINTS 16
+
+//xorshift64* - reproducible random numbers
+static uint64_t nextRandom(uint64_t * state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+//random pair of points: independent, sharing a random number of upper bits, equal, or partly outside of the grid
+static void randomPair(uint64_t * pointA, uint64_t * pointB, const int32_t m, const int32_t dim, uint64_t * state) {
+	uint64_t mask = m < 64 ? ((uint64_t)1 << m) - 1 : 0xFFFFFFFFFFFFFFFF;
+	uint64_t kind = nextRandom(state) % 4;
+	int32_t shared = (int32_t)(nextRandom(state) % (m + 1));
+	uint64_t lowMask = shared < m ? mask >> shared : 0;
+
+	for(int j=0; j<dim; j++) {
+		pointA[j] = nextRandom(state) & mask;
+
+		if(kind == 0) {
+			pointB[j] = nextRandom(state) & mask;
+		} else if(kind == 1) {
+			pointB[j] = (pointA[j] & ~lowMask) | (nextRandom(state) & lowMask);
+		} else if(kind == 2) {
+			pointB[j] = pointA[j];
+		} else {
+			//clamped to 2**m - 1 by the key functions
+			pointB[j] = (nextRandom(state) & 1) && m < 64 ? nextRandom(state) | ((uint64_t)1 << m) : nextRandom(state) & mask;
+		}
+	}
+}
+
+static int checkCompare() {
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	static uint64_t pointsA[HKEY_CHECK_PAIRS * HKEY_MAX_DIM];
+	static uint64_t pointsB[HKEY_CHECK_PAIRS * HKEY_MAX_DIM];
+	static int32_t order[HKEY_CHECK_PAIRS];
+	uint64_t numPairs = 0;
+	int failed = 0;
+	int err;
+
+	printf("checking comparison against key order\n");
+
+	for(int32_t dim=1; dim<=HKEY_MAX_DIM && !failed; dim++) {
+		for(int32_t m=1; m * dim <= 64 && m <= 63 && !failed; m++) {
+			for(int i=0; i<HKEY_CHECK_PAIRS; i++) {
+				randomPair(&pointsA[i * dim], &pointsB[i * dim], m, dim, &state);
+			}
+
+			compareHKeysFromIntCoords(order, m, dim, HKEY_CHECK_PAIRS, pointsA, pointsB, &err);
+			if(err != HKEY_ERR_OK) {
+				printf("  dim %i m %i: batched comparison failed with error %i\n", dim, m, err);
+				failed = 1;
+				break;
+			}
+
+			for(int i=0; i<HKEY_CHECK_PAIRS; i++) {
+				uint64_t keyA = getHKeyFromIntCoord(m, dim, &pointsA[i * dim], &err);
+				uint64_t keyB = getHKeyFromIntCoord(m, dim, &pointsB[i * dim], &err);
+				int32_t expected = keyA < keyB ? -1 : (keyA > keyB ? 1 : 0);
+				int32_t single = compareHKeyFromIntCoord(m, dim, &pointsA[i * dim], &pointsB[i * dim], &err);
+
+				if(single != expected || order[i] != expected) {
+					printf("  dim %i m %i pair %i: compare %i, batched %i, keys %i\n", dim, m, i, single, order[i], expected);
+					failed = 1;
+					break;
+				}
+			}
+
+			numPairs += HKEY_CHECK_PAIRS;
+		}
+	}
+
+	//2**m has to fit into 64 bits
+	compareHKeyFromIntCoord(64, 1, pointsA, pointsB, &err);
+	if(err != HKEY_ERR_PARAM) {
+		printf("  m = 64 not rejected by compareHKeyFromIntCoord (error %i)\n", err);
+		failed = 1;
+	}
+
+	compareHKeysFromIntCoords(order, 64, 1, 1, pointsA, pointsB, &err);
+	if(err != HKEY_ERR_PARAM) {
+		printf("  m = 64 not rejected by compareHKeysFromIntCoords (error %i)\n", err);
+		failed = 1;
+	}
+
+	printf("  %llu pairs\n", (unsigned long long)numPairs);
+	return failed;
+}
+
+//random orders of at most maxOrder per dimension with at most 64 bits in total, some dimensions
+//might have no bits at all
+static void randomOrders(int32_t * m, const int32_t dim, const int32_t maxOrder, uint64_t * state) {
+	int32_t bitsLeft = 64;
+
+	for(int j=0; j<dim; j++) {
+		int32_t limit = bitsLeft < maxOrder ? bitsLeft : maxOrder;
+		m[j] = (int32_t)(nextRandom(state) % (limit + 1));
+		bitsLeft -= m[j];
+	}
+
+	//shuffle, so that the first dimensions do not always get the larger orders
+	for(int j=dim-1; j>0; j--) {
+		int32_t other = (int32_t)(nextRandom(state) % (j + 1));
+		int32_t tmp = m[j];
+		m[j] = m[other];
+		m[other] = tmp;
+	}
+}
+
+static void randomGridPoint(uint64_t * point, const int32_t * m, const int32_t dim, uint64_t * state) {
+	for(int j=0; j<dim; j++) {
+		point[j] = m[j] < 64 ? nextRandom(state) & (((uint64_t)1 << m[j]) - 1) : nextRandom(state);
+	}
+}
+
+static int checkCompact() {
+	uint64_t state = 0xD1B54A32D192ED03ULL;
+	uint64_t points[HKEY_CHECK_GRID_POINTS * HKEY_MAX_DIM];
+	uint64_t keys[HKEY_CHECK_GRID_POINTS];
+	uint64_t coord[HKEY_MAX_DIM];
+	int32_t m[HKEY_MAX_DIM];
+	uint64_t numGrids = 0;
+	uint64_t numOrdered = 0;
+	int failed = 0;
+	int err;
+
+	printf("checking compact keys\n");
+
+	for(int g=0; g<HKEY_CHECK_GRIDS && !failed; g++) {
+		int32_t dim = 1 + (int32_t)(nextRandom(&state) % HKEY_MAX_DIM);
+		int32_t sumM = 0;
+		int32_t maxM = 0;
+
+		//every other grid is small enough to compare with the keys at the largest order
+		int32_t maxOrder = g % 2 == 0 ? 24 : (64 / dim < 63 ? 64 / dim : 63);
+
+		randomOrders(m, dim, maxOrder, &state);
+		for(int j=0; j<dim; j++) {
+			sumM += m[j];
+			maxM = m[j] > maxM ? m[j] : maxM;
+		}
+
+		for(int i=0; i<HKEY_CHECK_GRID_POINTS; i++) {
+			randomGridPoint(&points[i * dim], m, dim, &state);
+		}
+
+		getCompactHKeysFromIntCoords(keys, m, dim, HKEY_CHECK_GRID_POINTS, points, &err);
+		if(err != HKEY_ERR_OK) {
+			printf("  grid %i: batched encoding failed with error %i\n", g, err);
+			failed = 1;
+			break;
+		}
+
+		for(int i=0; i<HKEY_CHECK_GRID_POINTS && !failed; i++) {
+			uint64_t * point = &points[i * dim];
+			uint64_t key = getCompactHKeyFromIntCoord(m, dim, point, &err);
+
+			//points round trip through their key
+			getIntCoordFromCompactHKey(coord, m, dim, key, &err);
+			if(key != keys[i] || memcmp(coord, point, dim * sizeof(uint64_t)) != 0) {
+				printf("  grid %i point %i: point does not round trip\n", g, i);
+				failed = 1;
+				break;
+			}
+
+			//every key with sumM bits belongs to a grid point
+			uint64_t randomKey = sumM < 64 ? nextRandom(&state) & (((uint64_t)1 << sumM) - 1) : nextRandom(&state);
+			getIntCoordFromCompactHKey(coord, m, dim, randomKey, &err);
+			for(int j=0; j<dim; j++) {
+				if(m[j] < 64 && coord[j] >> m[j] != 0) {
+					failed = 1;
+				}
+			}
+			if(failed || getCompactHKeyFromIntCoord(m, dim, coord, &err) != randomKey) {
+				printf("  grid %i: key %llu does not round trip\n", g, (unsigned long long)randomKey);
+				failed = 1;
+				break;
+			}
+
+			//keys at the largest order need to fit into 64 bits for the order to be checked
+			if(maxM * dim > 64 || maxM > 63 || i == 0) {
+				continue;
+			}
+
+			uint64_t * prevPoint = &points[(i - 1) * dim];
+			uint64_t fullKey = getHKeyFromIntCoord(maxM, dim, point, &err);
+			uint64_t prevFullKey = getHKeyFromIntCoord(maxM, dim, prevPoint, &err);
+			int32_t expected = prevFullKey < fullKey ? -1 : (prevFullKey > fullKey ? 1 : 0);
+			int32_t order = keys[i - 1] < keys[i] ? -1 : (keys[i - 1] > keys[i] ? 1 : 0);
+
+			if(order != expected) {
+				printf("  grid %i point %i: compact key order %i, key order %i\n", g, i, order, expected);
+				failed = 1;
+				break;
+			}
+			numOrdered++;
+		}
+
+		numGrids++;
+	}
+
+	//with the same order in every dimension compact keys are the regular keys
+	for(int32_t dim=1; dim<=HKEY_MAX_DIM && !failed; dim++) {
+		for(int32_t order=1; order * dim <= 64 && order <= 63 && !failed; order++) {
+			for(int j=0; j<dim; j++) {
+				m[j] = order;
+			}
+
+			for(int i=0; i<HKEY_CHECK_GRID_POINTS; i++) {
+				randomGridPoint(coord, m, dim, &state);
+				if(getCompactHKeyFromIntCoord(m, dim, coord, &err) != getHKeyFromIntCoord(order, dim, coord, &err)) {
+					printf("  dim %i m %i: compact key differs from key\n", dim, order);
+					failed = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	printf("  %llu grids, %llu ordered pairs\n", (unsigned long long)numGrids, (unsigned long long)numOrdered);
+	return failed;
+}
+
+int main () {
+	int failed = 0;
+
+	failed |= checkCompare();
+	failed |= checkCompact();
+
+	printf(failed ? "FAILED\n" : "OK\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
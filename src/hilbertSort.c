@@ -0,0 +1,913 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include "hilbertSort.h"
+#include "hilbertKey.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//smallest read buffer per run in the merge, smaller buffers turn the merge into random I/O
+#define HSORT_MIN_READ_BUF (256 * 1024)
+//largest write buffer, anything beyond this does not speed up sequential writes
+#define HSORT_MAX_IO_BUF (8 * 1024 * 1024)
+//the run buffers are sorted by 8 bit digits of the key
+#define HSORT_RADIX_BITS 8
+#define HSORT_RADIX_SIZE (1 << HSORT_RADIX_BITS)
+#define HSORT_RADIX_PASSES (64 / HSORT_RADIX_BITS)
+
+//key and position of a record in the run buffer
+typedef struct {
+	uint64_t key;
+	uint64_t idx;
+} hsortEntry;
+
+//merge heap element: current key of a source, ties are broken by the source order to keep the sort stable.
+//head points to the current entry of a run in the merge and is unused when merging the slices of a run.
+typedef struct {
+	uint64_t key;
+	uint64_t tie;
+	int32_t src;
+	const char * head;
+} hsortHeapItem;
+
+//write-behind: one buffer is filled while the other is written by a background thread
+typedef struct {
+	FILE * file;
+	char * buf[2];
+	size_t size;
+	size_t len;
+	size_t pendingLen;
+	int cur;
+	int pending;
+	int done;
+	int err;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} hsortWriter;
+
+//one run in the merge, double buffered: one buffer is consumed while the other is read ahead
+typedef struct {
+	FILE * file;
+	char * buf[2];
+	size_t len[2];
+	int ready[2];
+	int cur;
+	size_t pos;
+	int err;
+} hsortStream;
+
+//read-ahead: a single background thread serves the refill requests of all runs in FIFO order
+typedef struct {
+	hsortStream * streams;
+	int32_t numStreams;
+	size_t bufSize;
+	int32_t * queue;
+	int32_t head;
+	int32_t count;
+	int done;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t requestCond;
+	pthread_cond_t readyCond;
+} hsortReader;
+
+typedef struct {
+	const hilbertSortConfig * config;
+	const char * records;
+	hsortEntry * entries;
+	hsortEntry * scratch;
+	uint64_t start;
+	uint64_t num;
+	int err;
+} hsortKeyTask;
+
+//stable LSD radix sort of entries by key, scratch needs room for num entries. Entries are created in
+//record order, so equal keys stay in record order. Digits shared by all keys are skipped, which leaves
+//only the passes over the m * dim bits actually used by the hilbert keys.
+static void radixSortEntries(hsortEntry * entries, hsortEntry * scratch, const uint64_t num) {
+	uint64_t count[HSORT_RADIX_PASSES][HSORT_RADIX_SIZE];
+	hsortEntry * src = entries;
+	hsortEntry * dst = scratch;
+
+	if(num < 2) {
+		return;
+	}
+
+	//one sweep collects the histograms of all digits
+	memset(count, 0, sizeof(count));
+	for(uint64_t i=0; i<num; i++) {
+		uint64_t key = entries[i].key;
+		for(int d=0; d<HSORT_RADIX_PASSES; d++) {
+			count[d][(key >> (d * HSORT_RADIX_BITS)) & (HSORT_RADIX_SIZE - 1)]++;
+		}
+	}
+
+	for(int d=0; d<HSORT_RADIX_PASSES; d++) {
+		int shift = d * HSORT_RADIX_BITS;
+
+		if(count[d][(entries[0].key >> shift) & (HSORT_RADIX_SIZE - 1)] == num) {
+			continue;
+		}
+
+		uint64_t offset = 0;
+		for(int b=0; b<HSORT_RADIX_SIZE; b++) {
+			uint64_t c = count[d][b];
+			count[d][b] = offset;
+			offset += c;
+		}
+
+		for(uint64_t i=0; i<num; i++) {
+			dst[count[d][(src[i].key >> shift) & (HSORT_RADIX_SIZE - 1)]++] = src[i];
+		}
+
+		hsortEntry * tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if(src != entries) {
+		memcpy(entries, src, num * sizeof(hsortEntry));
+	}
+}
+
+static int heapLess(const hsortHeapItem * a, const hsortHeapItem * b) {
+	if(a->key != b->key) {
+		return a->key < b->key;
+	}
+	return a->tie < b->tie;
+}
+
+static void heapSiftDown(hsortHeapItem * heap, const int32_t num, int32_t i) {
+	for(;;) {
+		int32_t smallest = i;
+		int32_t left = 2 * i + 1;
+		int32_t right = 2 * i + 2;
+
+		if(left < num && heapLess(&heap[left], &heap[smallest])) {
+			smallest = left;
+		}
+		if(right < num && heapLess(&heap[right], &heap[smallest])) {
+			smallest = right;
+		}
+		if(smallest == i) {
+			return;
+		}
+
+		hsortHeapItem tmp = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = tmp;
+		i = smallest;
+	}
+}
+
+static void heapBuild(hsortHeapItem * heap, const int32_t num) {
+	for(int32_t i=num/2-1; i>=0; i--) {
+		heapSiftDown(heap, num, i);
+	}
+}
+
+static FILE * openTempFile(const char * dir) {
+	char path[4096];
+
+	if(snprintf(path, sizeof(path), "%s/hilbertSortXXXXXX", dir) >= (int)sizeof(path)) {
+		return NULL;
+	}
+
+	int fd = mkstemp(path);
+	if(fd < 0) {
+		return NULL;
+	}
+
+	FILE * file = fdopen(fd, "w+b");
+	if(file == NULL) {
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+
+	//the file lives on as long as it is open, thus nothing is left behind if we die
+	unlink(path);
+	return file;
+}
+
+static void * writerThread(void * arg) {
+	hsortWriter * writer = (hsortWriter*)arg;
+
+	pthread_mutex_lock(&writer->mutex);
+	for(;;) {
+		while(!writer->pending && !writer->done) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		if(!writer->pending) {
+			break;
+		}
+
+		//the producer does not swap buffers while a write is pending
+		char * buf = writer->buf[1 - writer->cur];
+		size_t len = writer->pendingLen;
+		pthread_mutex_unlock(&writer->mutex);
+
+		size_t written = fwrite(buf, 1, len, writer->file);
+
+		pthread_mutex_lock(&writer->mutex);
+		if(written != len) {
+			writer->err = 1;
+		}
+		writer->pending = 0;
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
+
+static int writerOpen(hsortWriter * writer, FILE * file, const size_t size) {
+	memset(writer, 0, sizeof(hsortWriter));
+	writer->file = file;
+	writer->size = size;
+	writer->buf[0] = (char*)malloc(size);
+	writer->buf[1] = (char*)malloc(size);
+
+	if(writer->buf[0] == NULL || writer->buf[1] == NULL) {
+		free(writer->buf[0]);
+		free(writer->buf[1]);
+		return HKEY_ERR_NOMEM;
+	}
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+	if(pthread_create(&writer->thread, NULL, writerThread, writer) != 0) {
+		pthread_mutex_destroy(&writer->mutex);
+		pthread_cond_destroy(&writer->cond);
+		free(writer->buf[0]);
+		free(writer->buf[1]);
+		return HKEY_ERR_NOMEM;
+	}
+
+	return HKEY_ERR_OK;
+}
+
+static void writerFlush(hsortWriter * writer) {
+	pthread_mutex_lock(&writer->mutex);
+	while(writer->pending) {
+		pthread_cond_wait(&writer->cond, &writer->mutex);
+	}
+	writer->pending = 1;
+	writer->pendingLen = writer->len;
+	writer->cur = 1 - writer->cur;
+	writer->len = 0;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+static void writerPut(hsortWriter * writer, const char * data, size_t len) {
+	while(len > 0) {
+		size_t chunk = writer->size - writer->len;
+		if(chunk > len) {
+			chunk = len;
+		}
+
+		memcpy(writer->buf[writer->cur] + writer->len, data, chunk);
+		writer->len += chunk;
+		data += chunk;
+		len -= chunk;
+
+		if(writer->len == writer->size) {
+			writerFlush(writer);
+		}
+	}
+}
+
+static int writerClose(hsortWriter * writer) {
+	if(writer->len > 0) {
+		writerFlush(writer);
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->done = 1;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+
+	pthread_join(writer->thread, NULL);
+	pthread_mutex_destroy(&writer->mutex);
+	pthread_cond_destroy(&writer->cond);
+	free(writer->buf[0]);
+	free(writer->buf[1]);
+
+	if(writer->err || fflush(writer->file) != 0) {
+		return HKEY_ERR_IO;
+	}
+
+	return HKEY_ERR_OK;
+}
+
+static void * readerThread(void * arg) {
+	hsortReader * reader = (hsortReader*)arg;
+
+	pthread_mutex_lock(&reader->mutex);
+	for(;;) {
+		while(reader->count == 0 && !reader->done) {
+			pthread_cond_wait(&reader->requestCond, &reader->mutex);
+		}
+		//outstanding read-ahead is of no use once the merge is over
+		if(reader->done) {
+			break;
+		}
+
+		int32_t request = reader->queue[reader->head];
+		reader->head = (reader->head + 1) % (2 * reader->numStreams);
+		reader->count--;
+		pthread_mutex_unlock(&reader->mutex);
+
+		hsortStream * stream = &reader->streams[request / 2];
+		int32_t bufIdx = request % 2;
+		size_t len = fread(stream->buf[bufIdx], 1, reader->bufSize, stream->file);
+		int readErr = len < reader->bufSize && ferror(stream->file);
+
+		pthread_mutex_lock(&reader->mutex);
+		stream->len[bufIdx] = len;
+		stream->ready[bufIdx] = 1;
+		if(readErr) {
+			stream->err = 1;
+		}
+		pthread_cond_broadcast(&reader->readyCond);
+	}
+	pthread_mutex_unlock(&reader->mutex);
+
+	return NULL;
+}
+
+//has to be called with the reader mutex held
+static void readerRequest(hsortReader * reader, const int32_t streamIdx, const int32_t bufIdx) {
+	int32_t tail = (reader->head + reader->count) % (2 * reader->numStreams);
+
+	reader->streams[streamIdx].ready[bufIdx] = 0;
+	reader->queue[tail] = streamIdx * 2 + bufIdx;
+	reader->count++;
+	pthread_cond_signal(&reader->requestCond);
+}
+
+static void readerFree(hsortReader * reader) {
+	for(int32_t i=0; i<reader->numStreams; i++) {
+		free(reader->streams[i].buf[0]);
+		free(reader->streams[i].buf[1]);
+	}
+	free(reader->streams);
+	free(reader->queue);
+}
+
+static int readerOpen(hsortReader * reader, FILE ** files, const int32_t numStreams, const size_t bufSize) {
+	memset(reader, 0, sizeof(hsortReader));
+	reader->numStreams = numStreams;
+	reader->bufSize = bufSize;
+	reader->streams = (hsortStream*)calloc(numStreams, sizeof(hsortStream));
+	reader->queue = (int32_t*)malloc(2 * numStreams * sizeof(int32_t));
+	if(reader->streams == NULL || reader->queue == NULL) {
+		free(reader->streams);
+		free(reader->queue);
+		return HKEY_ERR_NOMEM;
+	}
+
+	for(int32_t i=0; i<numStreams; i++) {
+		hsortStream * stream = &reader->streams[i];
+		stream->file = files[i];
+		stream->buf[0] = (char*)malloc(bufSize);
+		stream->buf[1] = (char*)malloc(bufSize);
+
+		if(stream->buf[0] == NULL || stream->buf[1] == NULL) {
+			readerFree(reader);
+			return HKEY_ERR_NOMEM;
+		}
+		if(fseeko(stream->file, 0, SEEK_SET) != 0) {
+			readerFree(reader);
+			return HKEY_ERR_IO;
+		}
+	}
+
+	pthread_mutex_init(&reader->mutex, NULL);
+	pthread_cond_init(&reader->requestCond, NULL);
+	pthread_cond_init(&reader->readyCond, NULL);
+
+	//fill both buffers of every run, the FIFO order keeps the reads of each run sequential
+	for(int32_t i=0; i<numStreams; i++) {
+		readerRequest(reader, i, 0);
+		readerRequest(reader, i, 1);
+	}
+
+	if(pthread_create(&reader->thread, NULL, readerThread, reader) != 0) {
+		pthread_mutex_destroy(&reader->mutex);
+		pthread_cond_destroy(&reader->requestCond);
+		pthread_cond_destroy(&reader->readyCond);
+		readerFree(reader);
+		return HKEY_ERR_NOMEM;
+	}
+
+	return HKEY_ERR_OK;
+}
+
+static void readerClose(hsortReader * reader) {
+	pthread_mutex_lock(&reader->mutex);
+	reader->done = 1;
+	pthread_cond_broadcast(&reader->requestCond);
+	pthread_mutex_unlock(&reader->mutex);
+
+	pthread_join(reader->thread, NULL);
+	pthread_mutex_destroy(&reader->mutex);
+	pthread_cond_destroy(&reader->requestCond);
+	pthread_cond_destroy(&reader->readyCond);
+	readerFree(reader);
+}
+
+//waits for the current buffer of a run and returns its current entry, NULL if the run is exhausted
+//or could not be read. Only needed at the start and after switching buffers, a buffer stays ready
+//until it is handed back for read-ahead.
+static const char * streamWait(hsortReader * reader, const int32_t streamIdx) {
+	hsortStream * stream = &reader->streams[streamIdx];
+
+	pthread_mutex_lock(&reader->mutex);
+	while(!stream->ready[stream->cur]) {
+		pthread_cond_wait(&reader->readyCond, &reader->mutex);
+	}
+	pthread_mutex_unlock(&reader->mutex);
+
+	if(stream->err || stream->pos >= stream->len[stream->cur]) {
+		return NULL;
+	}
+
+	return stream->buf[stream->cur] + stream->pos;
+}
+
+//moves on to the next entry of a run and returns it, NULL if the run is exhausted or could not be read
+static const char * streamNext(hsortReader * reader, const int32_t streamIdx, const size_t entrySize) {
+	hsortStream * stream = &reader->streams[streamIdx];
+
+	stream->pos += entrySize;
+	if(stream->pos < stream->len[stream->cur]) {
+		return stream->buf[stream->cur] + stream->pos;
+	}
+
+	//a short buffer marks the end of the run
+	if(stream->len[stream->cur] < reader->bufSize) {
+		return NULL;
+	}
+
+	//hand the drained buffer back for read-ahead and continue with the other one
+	pthread_mutex_lock(&reader->mutex);
+	readerRequest(reader, streamIdx, stream->cur);
+	pthread_mutex_unlock(&reader->mutex);
+
+	stream->cur = 1 - stream->cur;
+	stream->pos = 0;
+
+	return streamWait(reader, streamIdx);
+}
+
+static uint64_t recordKey(const hilbertSortConfig * config, const char * record, int * err) {
+	if(config->keyFunc != NULL) {
+		*err = HKEY_ERR_OK;
+		return config->keyFunc(record, config->keyUserData);
+	}
+
+	//coordinates might not be aligned within the record
+	if(config->coordType == HSORT_COORD_DOUBLE) {
+		double point[config->dim];
+		memcpy(point, record + config->coordOffset, config->dim * sizeof(double));
+		return getHKeyFromCoord(config->m, config->boxSize, config->dim, point, err);
+	}
+
+	uint64_t point[config->dim];
+	memcpy(point, record + config->coordOffset, config->dim * sizeof(uint64_t));
+	return getHKeyFromIntCoord(config->m, config->dim, point, err);
+}
+
+static void * keyTaskThread(void * arg) {
+	hsortKeyTask * task = (hsortKeyTask*)arg;
+	size_t recordSize = task->config->recordSize;
+
+	task->err = HKEY_ERR_OK;
+	for(uint64_t i=task->start; i<task->start+task->num; i++) {
+		int err;
+
+		task->entries[i].key = recordKey(task->config, task->records + i * recordSize, &err);
+		task->entries[i].idx = i;
+
+		if(err != HKEY_ERR_OK) {
+			task->err = err;
+			return NULL;
+		}
+	}
+
+	radixSortEntries(&task->entries[task->start], &task->scratch[task->start], task->num);
+	return NULL;
+}
+
+//keys and sorts one chunk of records with several threads and writes it as a run of (key, record) entries
+static int writeRun(const hilbertSortConfig * config, const char * records, hsortEntry * entries,
+					hsortEntry * scratch, const uint64_t numRecords, FILE * runFile, const size_t ioBufSize) {
+	int32_t numThreads = config->numThreads;
+	if((uint64_t)numThreads > numRecords) {
+		numThreads = (int32_t)numRecords;
+	}
+
+	hsortKeyTask tasks[numThreads];
+	pthread_t threads[numThreads];
+	hsortHeapItem heap[numThreads];
+	uint64_t sliceEnd[numThreads];
+	uint64_t chunk = (numRecords + numThreads - 1) / numThreads;
+	int err = HKEY_ERR_OK;
+	int32_t numStarted = 0;
+
+	for(int32_t t=0; t<numThreads; t++) {
+		tasks[t].config = config;
+		tasks[t].records = records;
+		tasks[t].entries = entries;
+		tasks[t].scratch = scratch;
+		tasks[t].start = t * chunk < numRecords ? t * chunk : numRecords;
+		tasks[t].num = tasks[t].start + chunk < numRecords ? chunk : numRecords - tasks[t].start;
+		sliceEnd[t] = tasks[t].start + tasks[t].num;
+	}
+
+	for(int32_t t=1; t<numThreads; t++) {
+		if(pthread_create(&threads[t], NULL, keyTaskThread, &tasks[t]) != 0) {
+			err = HKEY_ERR_NOMEM;
+			break;
+		}
+		numStarted++;
+	}
+	keyTaskThread(&tasks[0]);
+	for(int32_t t=1; t<=numStarted; t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	if(err != HKEY_ERR_OK) {
+		return err;
+	}
+	for(int32_t t=0; t<numThreads; t++) {
+		if(tasks[t].err != HKEY_ERR_OK) {
+			return tasks[t].err;
+		}
+	}
+
+	//merge the sorted slices of the threads while writing the run
+	hsortWriter writer;
+	err = writerOpen(&writer, runFile, ioBufSize);
+	if(err != HKEY_ERR_OK) {
+		return err;
+	}
+
+	int32_t heapSize = 0;
+	uint64_t pos[numThreads];
+	for(int32_t t=0; t<numThreads; t++) {
+		pos[t] = tasks[t].start;
+		if(tasks[t].num > 0) {
+			heap[heapSize].key = entries[pos[t]].key;
+			heap[heapSize].tie = entries[pos[t]].idx;
+			heap[heapSize].src = t;
+			heap[heapSize].head = NULL;
+			heapSize++;
+		}
+	}
+	heapBuild(heap, heapSize);
+
+	while(heapSize > 0) {
+		int32_t src = heap[0].src;
+		hsortEntry * entry = &entries[pos[src]];
+
+		writerPut(&writer, (const char*)&entry->key, sizeof(uint64_t));
+		writerPut(&writer, records + entry->idx * config->recordSize, config->recordSize);
+
+		pos[src]++;
+		if(pos[src] < sliceEnd[src]) {
+			heap[0].key = entries[pos[src]].key;
+			heap[0].tie = entries[pos[src]].idx;
+		} else {
+			heap[0] = heap[--heapSize];
+		}
+		heapSiftDown(heap, heapSize, 0);
+	}
+
+	return writerClose(&writer);
+}
+
+//k-way merge of runs. Writes (key, record) entries to out if keepKeys is set, otherwise bare records.
+//If index is given, every indexInterval-th key is written there together with its offset in out.
+static int mergeRuns(FILE ** runs, const int32_t numRuns, const hilbertSortConfig * config, const size_t readBufSize,
+					hsortWriter * out, const int keepKeys, FILE * index) {
+	size_t entrySize = config->recordSize + sizeof(uint64_t);
+	hsortReader reader;
+	hsortHeapItem heap[numRuns];
+	int32_t heapSize = 0;
+	uint64_t numWritten = 0;
+	int err = HKEY_ERR_OK;
+
+	err = readerOpen(&reader, runs, numRuns, readBufSize);
+	if(err != HKEY_ERR_OK) {
+		return err;
+	}
+
+	for(int32_t i=0; i<numRuns; i++) {
+		const char * head = streamWait(&reader, i);
+		if(head != NULL) {
+			memcpy(&heap[heapSize].key, head, sizeof(uint64_t));
+			heap[heapSize].tie = i;
+			heap[heapSize].src = i;
+			heap[heapSize].head = head;
+			heapSize++;
+		}
+	}
+	heapBuild(heap, heapSize);
+
+	while(heapSize > 0) {
+		int32_t src = heap[0].src;
+		const char * head = heap[0].head;
+
+		if(keepKeys) {
+			writerPut(out, head, entrySize);
+		} else {
+			writerPut(out, head + sizeof(uint64_t), config->recordSize);
+		}
+
+		if(index != NULL && numWritten % config->indexInterval == 0) {
+			uint64_t indexEntry[2];
+			indexEntry[0] = heap[0].key;
+			indexEntry[1] = numWritten * config->recordSize;
+			if(fwrite(indexEntry, sizeof(uint64_t), 2, index) != 2) {
+				err = HKEY_ERR_IO;
+				break;
+			}
+		}
+		numWritten++;
+
+		head = streamNext(&reader, src, entrySize);
+		if(head != NULL) {
+			memcpy(&heap[0].key, head, sizeof(uint64_t));
+			heap[0].head = head;
+		} else {
+			heap[0] = heap[--heapSize];
+		}
+		heapSiftDown(heap, heapSize, 0);
+	}
+
+	for(int32_t i=0; i<numRuns; i++) {
+		if(reader.streams[i].err) {
+			err = HKEY_ERR_IO;
+		}
+	}
+
+	readerClose(&reader);
+	return err;
+}
+
+static void closeRuns(FILE ** runs, const int32_t numRuns) {
+	for(int32_t i=0; i<numRuns; i++) {
+		if(runs[i] != NULL) {
+			fclose(runs[i]);
+		}
+	}
+}
+
+void hilbertSortDefaultConfig( hilbertSortConfig * config ) {
+	memset(config, 0, sizeof(hilbertSortConfig));
+	config->coordOffset = 0;
+	config->coordType = HSORT_COORD_UINT64;
+	config->boxSize = 1.0;
+	config->keyFunc = NULL;
+	config->keyUserData = NULL;
+	config->memoryLimit = (size_t)1 << 30;
+	config->numThreads = 4;
+	config->tmpDir = "/tmp";
+	config->indexInterval = 4096;
+}
+
+void hilbertSortFile( const char * inFile, const char * outFile, const char * indexFile, const hilbertSortConfig * config, int * err ) {
+	size_t recordSize = config->recordSize;
+	size_t coordSize = config->coordType == HSORT_COORD_DOUBLE ? sizeof(double) : sizeof(uint64_t);
+
+	if(recordSize == 0 || config->numThreads < 1 || config->indexInterval == 0 || config->tmpDir == NULL) {
+		*err = HKEY_ERR_PARAM;
+		return;
+	}
+
+	//without a key function the coordinates need to fit into the record and the key into 64 bits
+	if(config->keyFunc == NULL) {
+		if((config->coordType != HSORT_COORD_UINT64 && config->coordType != HSORT_COORD_DOUBLE) ||
+				config->dim < 1 || config->dim > HKEY_MAX_DIM || config->m < 1 || config->m > 63 || (int64_t)config->m * config->dim > 64 ||
+				config->coordOffset + config->dim * coordSize > recordSize) {
+			*err = HKEY_ERR_PARAM;
+			return;
+		}
+	}
+
+	//memory layout: two write buffers, the rest goes to the run buffer (records, entries and the
+	//scratch entries of the radix sort) during run generation and to the double buffered reads of the runs during the merge
+	size_t entrySize = recordSize + sizeof(uint64_t);
+	size_t ioBufSize = config->memoryLimit / 16;
+	if(ioBufSize > HSORT_MAX_IO_BUF) {
+		ioBufSize = HSORT_MAX_IO_BUF;
+	}
+	ioBufSize -= ioBufSize % entrySize;
+	if(ioBufSize == 0) {
+		ioBufSize = entrySize;
+	}
+
+	if(config->memoryLimit <= 2 * ioBufSize) {
+		*err = HKEY_ERR_NOMEM;
+		return;
+	}
+	size_t available = config->memoryLimit - 2 * ioBufSize;
+
+	uint64_t runRecords = available / (recordSize + 2 * sizeof(hsortEntry));
+	size_t minReadBufSize = HSORT_MIN_READ_BUF - HSORT_MIN_READ_BUF % entrySize;
+	if(minReadBufSize > available / 4) {
+		minReadBufSize = available / 4 - (available / 4) % entrySize;
+	}
+	if(minReadBufSize == 0) {
+		minReadBufSize = entrySize;
+	}
+	int64_t maxFanIn = available / (2 * minReadBufSize);
+
+	if(runRecords == 0 || maxFanIn < 2) {
+		*err = HKEY_ERR_NOMEM;
+		return;
+	}
+
+	FILE * in = fopen(inFile, "rb");
+	if(in == NULL) {
+		*err = HKEY_ERR_IO;
+		return;
+	}
+
+	//phase one: read large sequential chunks, key and sort them in parallel and spill them as runs
+	char * records = (char*)malloc(runRecords * recordSize);
+	hsortEntry * entries = (hsortEntry*)malloc(runRecords * sizeof(hsortEntry));
+	hsortEntry * scratch = (hsortEntry*)malloc(runRecords * sizeof(hsortEntry));
+	int32_t numRuns = 0;
+	int32_t maxRuns = 64;
+	FILE ** runs = (FILE**)malloc(maxRuns * sizeof(FILE*));
+
+	if(records == NULL || entries == NULL || scratch == NULL || runs == NULL) {
+		free(records);
+		free(entries);
+		free(scratch);
+		free(runs);
+		fclose(in);
+		*err = HKEY_ERR_NOMEM;
+		return;
+	}
+
+	*err = HKEY_ERR_OK;
+	for(;;) {
+		size_t bytesRead = fread(records, 1, runRecords * recordSize, in);
+
+		if(bytesRead < runRecords * recordSize && ferror(in)) {
+			*err = HKEY_ERR_IO;
+			break;
+		}
+		if(bytesRead % recordSize != 0) {
+			*err = HKEY_ERR_PARAM;
+			break;
+		}
+		if(bytesRead == 0) {
+			break;
+		}
+
+		if(numRuns == maxRuns) {
+			FILE ** newRuns = (FILE**)realloc(runs, 2 * maxRuns * sizeof(FILE*));
+			if(newRuns == NULL) {
+				*err = HKEY_ERR_NOMEM;
+				break;
+			}
+			runs = newRuns;
+			maxRuns *= 2;
+		}
+
+		runs[numRuns] = openTempFile(config->tmpDir);
+		if(runs[numRuns] == NULL) {
+			*err = HKEY_ERR_IO;
+			break;
+		}
+		numRuns++;
+
+		*err = writeRun(config, records, entries, scratch, bytesRead / recordSize, runs[numRuns - 1], ioBufSize);
+		if(*err != HKEY_ERR_OK || bytesRead < runRecords * recordSize) {
+			break;
+		}
+	}
+
+	fclose(in);
+	free(records);
+	free(entries);
+	free(scratch);
+
+	if(*err != HKEY_ERR_OK) {
+		closeRuns(runs, numRuns);
+		free(runs);
+		return;
+	}
+
+	//phase two: merge groups of runs until few enough are left to merge them in one go
+	while(numRuns > maxFanIn) {
+		int32_t numMerged = 0;
+
+		for(int32_t start=0; start<numRuns; start+=maxFanIn) {
+			int32_t groupSize = numRuns - start < maxFanIn ? numRuns - start : (int32_t)maxFanIn;
+			size_t readBufSize = available / (2 * groupSize);
+			readBufSize -= readBufSize % entrySize;
+
+			FILE * merged = openTempFile(config->tmpDir);
+			if(merged == NULL) {
+				*err = HKEY_ERR_IO;
+				break;
+			}
+
+			hsortWriter writer;
+			*err = writerOpen(&writer, merged, ioBufSize);
+			if(*err == HKEY_ERR_OK) {
+				*err = mergeRuns(&runs[start], groupSize, config, readBufSize, &writer, 1, NULL);
+				int closeErr = writerClose(&writer);
+				if(*err == HKEY_ERR_OK) {
+					*err = closeErr;
+				}
+			}
+
+			closeRuns(&runs[start], groupSize);
+			for(int32_t i=start; i<start+groupSize; i++) {
+				runs[i] = NULL;
+			}
+
+			if(*err != HKEY_ERR_OK) {
+				fclose(merged);
+				break;
+			}
+
+			//the merged runs lie before start, so the slot can be reused
+			runs[numMerged++] = merged;
+		}
+
+		if(*err != HKEY_ERR_OK) {
+			closeRuns(runs, numRuns);
+			free(runs);
+			return;
+		}
+
+		numRuns = numMerged;
+	}
+
+	//final merge into the output file and the index
+	FILE * out = fopen(outFile, "wb");
+	FILE * index = NULL;
+	if(out != NULL && indexFile != NULL) {
+		index = fopen(indexFile, "wb");
+	}
+
+	if(out == NULL || (indexFile != NULL && index == NULL)) {
+		*err = HKEY_ERR_IO;
+	} else if(numRuns > 0) {
+		size_t readBufSize = available / (2 * numRuns);
+		readBufSize -= readBufSize % entrySize;
+
+		hsortWriter writer;
+		*err = writerOpen(&writer, out, ioBufSize);
+		if(*err == HKEY_ERR_OK) {
+			*err = mergeRuns(runs, numRuns, config, readBufSize, &writer, 0, index);
+			int closeErr = writerClose(&writer);
+			if(*err == HKEY_ERR_OK) {
+				*err = closeErr;
+			}
+		}
+	}
+
+	if(out != NULL && fclose(out) != 0 && *err == HKEY_ERR_OK) {
+		*err = HKEY_ERR_IO;
+	}
+	if(index != NULL && fclose(index) != 0 && *err == HKEY_ERR_OK) {
+		*err = HKEY_ERR_IO;
+	}
+
+	closeRuns(runs, numRuns);
+	free(runs);
+	return;
+}
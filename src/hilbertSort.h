@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*! \file hilbertSort.h
+ \brief External sort of record files by Hilbert key
+
+ Sorts files of fixed size binary records along the Hilbert curve with bounded memory.
+ The input is read in large sequential chunks. Every chunk is keyed and sorted in memory
+ by several threads and spilled to a temporary run file. The runs are then merged with
+ asynchronous read-ahead and write-behind, in several passes if there are more runs than
+ the memory allows to merge at once. The sort is stable.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef __CLASS_HILBSORT__
+#define __CLASS_HILBSORT__
+
+#define HSORT_COORD_UINT64 0
+#define HSORT_COORD_DOUBLE 1
+
+/*! \brief user defined key function
+ \param const void * record:   	pointer to one record
+ \param void * userData:   		pointer given in hilbertSortConfig
+ \return uint64_t sort key of the record*/
+typedef uint64_t (*hilbertSortKeyFunc)( const void * record, void * userData );
+
+/*! \brief configuration of the external sort
+
+ recordSize:		size of one record in bytes
+ coordOffset:		byte offset of the coordinates in the record (dim consecutive values)
+ coordType:		HSORT_COORD_UINT64 (keyed with getHKeyFromIntCoord) or
+ 				HSORT_COORD_DOUBLE (keyed with getHKeyFromCoord using boxSize)
+ m, dim, boxSize:	hilbert order, number of dimensions and box size for the key functions
+ keyFunc:			if not NULL, used instead of the coordinates to obtain the key of a record
+ keyUserData:		passed to keyFunc
+ memoryLimit:		upper bound in bytes for the buffers used by the sort
+ numThreads:		number of threads keying and sorting the runs
+ tmpDir:			directory for the temporary run files
+ indexInterval:	every indexInterval-th record of the output is added to the index*/
+typedef struct {
+	size_t recordSize;
+	size_t coordOffset;
+	int coordType;
+	int32_t m;
+	int32_t dim;
+	double boxSize;
+	hilbertSortKeyFunc keyFunc;
+	void * keyUserData;
+	size_t memoryLimit;
+	int32_t numThreads;
+	const char * tmpDir;
+	uint64_t indexInterval;
+} hilbertSortConfig;
+
+/*! \brief initialise a configuration with default values
+ \param hilbertSortConfig * config: configuration to fill
+
+ Sets 1 GB of memory, 4 threads, /tmp as temporary directory, one index entry every
+ 4096 records and uint64 coordinates at the beginning of the record. recordSize, m and
+ dim need to be set by the caller.*/
+void hilbertSortDefaultConfig( hilbertSortConfig * config );
+
+/*! \brief sort a file of fixed size records by Hilbert key
+ \param const char * inFile:   	input file with records
+ \param const char * outFile:   	output file, receives the records in Hilbert order
+ \param const char * indexFile:  output file for the sparse index, may be NULL
+ \param const hilbertSortConfig * config: sort configuration
+ \param int * err:   			output variable for error handling
+
+ The index consists of (uint64_t key, uint64_t byte offset in outFile) pairs in native
+ byte order for every config->indexInterval-th record of the sorted output. Temporary run
+ files are unlinked directly after creation, so they are removed even if the process dies.
+ Every run keeps a file descriptor open until it is merged, so the input size divided by
+ the memory limit has to stay below the open file limit of the process.
+ Returns HKEY_ERR_PARAM for invalid configurations or input sizes that are not a multiple
+ of the record size, HKEY_ERR_NOMEM if memoryLimit is too small and HKEY_ERR_IO on file errors.
+ Without keyFunc, m has to be between 1 and 63, dim at most HKEY_MAX_DIM, m * dim at most 64
+ and coordType one of HSORT_COORD_UINT64 or HSORT_COORD_DOUBLE. Invalid configurations are
+ rejected before any file is opened.*/
+void hilbertSortFile( const char * inFile, const char * outFile, const char * indexFile, const hilbertSortConfig * config, int * err );
+
+#endif
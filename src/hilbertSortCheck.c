@@ -0,0 +1,275 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*! \file hilbertSortCheck.c
+ \brief Consistency check for the external sort
+
+ Generates record files with many duplicate keys, sorts them with a memory limit small
+ enough to force several merge passes and verifies the key order, the stability of the
+ sort, that every record is written exactly once and the entries of the sparse index.
+ Invalid configurations have to be rejected. Exits with a non zero status on failure.
+
+ Usage: hilbertSortCheck [work directory]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "hilbertKey.h"
+#include "hilbertSort.h"
+
+#define HSORT_CHECK_M 6
+#define HSORT_CHECK_DIM 3
+#define HSORT_CHECK_INDEX 100
+
+typedef struct {
+	uint64_t coord[HSORT_CHECK_DIM];
+	uint64_t id;
+	uint64_t payload;
+} checkRecord;
+
+static char inFile[4096];
+static char outFile[4096];
+static char indexFile[4096];
+
+static void checkConfig(hilbertSortConfig * config, const size_t memoryLimit) {
+	hilbertSortDefaultConfig(config);
+	config->recordSize = sizeof(checkRecord);
+	config->m = HSORT_CHECK_M;
+	config->dim = HSORT_CHECK_DIM;
+	config->memoryLimit = memoryLimit;
+	config->numThreads = 3;
+	config->indexInterval = HSORT_CHECK_INDEX;
+}
+
+static int writeInput(const uint64_t numRecords) {
+	FILE * file = fopen(inFile, "wb");
+	if(file == NULL) {
+		return 0;
+	}
+
+	//few distinct coordinates, so that stability is checked on many equal keys
+	srand(1);
+	for(uint64_t i=0; i<numRecords; i++) {
+		checkRecord record;
+		for(int j=0; j<HSORT_CHECK_DIM; j++) {
+			record.coord[j] = rand() % (1 << HSORT_CHECK_M);
+		}
+		record.id = i;
+		record.payload = ~i;
+
+		if(fwrite(&record, sizeof(checkRecord), 1, file) != 1) {
+			fclose(file);
+			return 0;
+		}
+	}
+
+	fclose(file);
+	return 1;
+}
+
+static int checkOutput(const uint64_t numRecords) {
+	int err = HKEY_ERR_OK;
+	int failed = 0;
+	uint64_t count = 0;
+	uint64_t numIndex = 0;
+	uint64_t prevId = 0;
+	checkRecord record;
+	uint64_t entry[2];
+
+	uint64_t * keys = (uint64_t*)malloc((numRecords + 1) * sizeof(uint64_t));
+	char * seen = (char*)calloc(numRecords + 1, 1);
+	if(keys == NULL || seen == NULL) {
+		free(keys);
+		free(seen);
+		printf("  out of memory\n");
+		return 1;
+	}
+
+	FILE * file = fopen(outFile, "rb");
+	if(file == NULL) {
+		free(keys);
+		free(seen);
+		printf("  cannot open %s\n", outFile);
+		return 1;
+	}
+
+	while(fread(&record, sizeof(checkRecord), 1, file) == 1) {
+		if(count >= numRecords || record.id >= numRecords || record.payload != ~record.id) {
+			printf("  corrupt record at %llu\n", (unsigned long long)count);
+			failed = 1;
+			break;
+		}
+
+		keys[count] = getHKeyFromIntCoord(HSORT_CHECK_M, HSORT_CHECK_DIM, record.coord, &err);
+
+		if(seen[record.id]) {
+			printf("  record %llu written twice\n", (unsigned long long)record.id);
+			failed = 1;
+		}
+		seen[record.id] = 1;
+
+		if(count > 0 && keys[count] < keys[count - 1]) {
+			printf("  key order violated at %llu\n", (unsigned long long)count);
+			failed = 1;
+		}
+
+		if(count > 0 && keys[count] == keys[count - 1] && record.id < prevId) {
+			printf("  sort not stable at %llu\n", (unsigned long long)count);
+			failed = 1;
+		}
+
+		prevId = record.id;
+		count++;
+	}
+	fclose(file);
+
+	if(!failed && count != numRecords) {
+		printf("  %llu of %llu records written\n", (unsigned long long)count, (unsigned long long)numRecords);
+		failed = 1;
+	}
+
+	if(!failed) {
+		file = fopen(indexFile, "rb");
+		if(file == NULL) {
+			printf("  cannot open %s\n", indexFile);
+			failed = 1;
+		} else {
+			while(fread(entry, sizeof(uint64_t), 2, file) == 2) {
+				uint64_t pos = entry[1] / sizeof(checkRecord);
+
+				if(entry[1] % sizeof(checkRecord) != 0 || pos != numIndex * HSORT_CHECK_INDEX ||
+						pos >= numRecords || keys[pos] != entry[0]) {
+					printf("  wrong index entry %llu\n", (unsigned long long)numIndex);
+					failed = 1;
+					break;
+				}
+				numIndex++;
+			}
+			fclose(file);
+
+			if(!failed && numIndex != (numRecords + HSORT_CHECK_INDEX - 1) / HSORT_CHECK_INDEX) {
+				printf("  %llu index entries\n", (unsigned long long)numIndex);
+				failed = 1;
+			}
+		}
+	}
+
+	free(keys);
+	free(seen);
+	return failed;
+}
+
+static int checkSort(const uint64_t numRecords, const size_t memoryLimit) {
+	hilbertSortConfig config;
+	int err = HKEY_ERR_OK;
+
+	printf("sorting %llu records with %llu bytes of memory\n", (unsigned long long)numRecords, (unsigned long long)memoryLimit);
+
+	if(!writeInput(numRecords)) {
+		printf("  cannot write %s\n", inFile);
+		return 1;
+	}
+
+	checkConfig(&config, memoryLimit);
+	hilbertSortFile(inFile, outFile, indexFile, &config, &err);
+	if(err != HKEY_ERR_OK) {
+		printf("  sort failed with error %i\n", err);
+		return 1;
+	}
+
+	return checkOutput(numRecords);
+}
+
+static int checkReject(const char * what, const hilbertSortConfig * config) {
+	int err = HKEY_ERR_OK;
+
+	hilbertSortFile(inFile, outFile, indexFile, config, &err);
+	if(err != HKEY_ERR_PARAM) {
+		printf("  %s not rejected (error %i)\n", what, err);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int checkParameters() {
+	hilbertSortConfig config;
+	int failed = 0;
+
+	printf("checking parameter validation\n");
+
+	if(!writeInput(10)) {
+		printf("  cannot write %s\n", inFile);
+		return 1;
+	}
+
+	checkConfig(&config, 1 << 20);
+	config.m = 0;
+	failed |= checkReject("m = 0", &config);
+
+	checkConfig(&config, 1 << 20);
+	config.m = 22;
+	failed |= checkReject("m * dim > 64", &config);
+
+	//2**64 cells do not fit into the coordinates of the key functions
+	checkConfig(&config, 1 << 20);
+	config.m = 64;
+	config.dim = 1;
+	failed |= checkReject("m = 64", &config);
+
+	checkConfig(&config, 1 << 20);
+	config.dim = HKEY_MAX_DIM + 1;
+	config.recordSize = (HKEY_MAX_DIM + 1) * sizeof(uint64_t);
+	failed |= checkReject("dim > HKEY_MAX_DIM", &config);
+
+	checkConfig(&config, 1 << 20);
+	config.coordType = 2;
+	failed |= checkReject("unknown coordType", &config);
+
+	checkConfig(&config, 1 << 20);
+	config.coordOffset = sizeof(uint64_t) * 3;
+	failed |= checkReject("coordinates outside of the record", &config);
+
+	return failed;
+}
+
+int main (int argc, char * const argv[]) {
+	const char * workDir = argc > 1 ? argv[1] : ".";
+	int failed = 0;
+
+	snprintf(inFile, sizeof(inFile), "%s/hsortCheck.in", workDir);
+	snprintf(outFile, sizeof(outFile), "%s/hsortCheck.out", workDir);
+	snprintf(indexFile, sizeof(indexFile), "%s/hsortCheck.idx", workDir);
+
+	failed |= checkSort(0, 1 << 20);
+	failed |= checkSort(1, 1 << 20);
+	//fits into a single run
+	failed |= checkSort(20000, 1 << 24);
+	//tiny memory limit: many runs with a small fan-in, merged in several passes
+	failed |= checkSort(100000, 400000);
+	failed |= checkParameters();
+
+	remove(inFile);
+	remove(outFile);
+	remove(indexFile);
+
+	printf(failed ? "FAILED\n" : "OK\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
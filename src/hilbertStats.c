@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "hilbertStats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HKEY_STATS
+
+#include <pthread.h>
+#include <time.h>
+
+//blocks are allocated cache line aligned, so that counters of different threads never share a line
+#define HKEY_STATS_CACHE_LINE 64
+
+//every thread owns one block, linked into a global list so that snapshots can sum them up.
+//stats is only written by the owning thread, baseline holds the counters at the last reset.
+typedef struct hkeyStatsBlock {
+	hkeyStats stats;
+	hkeyStats baseline;
+	struct hkeyStatsBlock * next;
+	struct hkeyStatsBlock * prev;
+} hkeyStatsBlock;
+
+__thread hkeyStats * hkeyStatsLocal = NULL;
+hkeyStatsTimingHook hkeyStatsHook = NULL;
+static void * hkeyStatsHookData = NULL;
+
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t statsOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t statsKey;
+static hkeyStatsBlock * statsBlocks = NULL;
+static hkeyStats statsRetired;
+
+static void addStats(hkeyStats * dest, const hkeyStats * src) {
+	dest->encodeCalls += src->encodeCalls;
+	dest->decodeCalls += src->decodeCalls;
+	dest->batchEncodeCalls += src->batchEncodeCalls;
+	dest->batchDecodeCalls += src->batchDecodeCalls;
+	dest->pointsEncoded += src->pointsEncoded;
+	dest->keysDecoded += src->keysDecoded;
+	dest->compareCalls += src->compareCalls;
+	dest->batchCompareCalls += src->batchCompareCalls;
+	dest->pairsCompared += src->pairsCompared;
+	dest->compareLevels += src->compareLevels;
+	dest->clampedCoords += src->clampedCoords;
+	dest->dimErrors += src->dimErrors;
+
+	for(int i=0; i<HKEY_MAX_DIM; i++) {
+		dest->kernelCalls[i] += src->kernelCalls[i];
+	}
+}
+
+//adds the counters of a block since the last reset to dest - has to be called with the stats mutex held
+static void addBlockStats(hkeyStats * dest, const hkeyStatsBlock * block) {
+	hkeyStats current;
+
+	memcpy(&current, &block->stats, sizeof(hkeyStats));
+
+	dest->encodeCalls += current.encodeCalls - block->baseline.encodeCalls;
+	dest->decodeCalls += current.decodeCalls - block->baseline.decodeCalls;
+	dest->batchEncodeCalls += current.batchEncodeCalls - block->baseline.batchEncodeCalls;
+	dest->batchDecodeCalls += current.batchDecodeCalls - block->baseline.batchDecodeCalls;
+	dest->pointsEncoded += current.pointsEncoded - block->baseline.pointsEncoded;
+	dest->keysDecoded += current.keysDecoded - block->baseline.keysDecoded;
+	dest->compareCalls += current.compareCalls - block->baseline.compareCalls;
+	dest->batchCompareCalls += current.batchCompareCalls - block->baseline.batchCompareCalls;
+	dest->pairsCompared += current.pairsCompared - block->baseline.pairsCompared;
+	dest->compareLevels += current.compareLevels - block->baseline.compareLevels;
+	dest->clampedCoords += current.clampedCoords - block->baseline.clampedCoords;
+	dest->dimErrors += current.dimErrors - block->baseline.dimErrors;
+
+	for(int i=0; i<HKEY_MAX_DIM; i++) {
+		dest->kernelCalls[i] += current.kernelCalls[i] - block->baseline.kernelCalls[i];
+	}
+}
+
+//called on thread exit: fold the counters into the retired totals and unlink the block
+static void retireThread(void * arg) {
+	hkeyStatsBlock * block = (hkeyStatsBlock*)arg;
+
+	//runs on the exiting thread, library calls from later destructors register a new block
+	hkeyStatsLocal = NULL;
+
+	pthread_mutex_lock(&statsMutex);
+	addBlockStats(&statsRetired, block);
+
+	if(block->prev != NULL) {
+		block->prev->next = block->next;
+	} else {
+		statsBlocks = block->next;
+	}
+	if(block->next != NULL) {
+		block->next->prev = block->prev;
+	}
+	pthread_mutex_unlock(&statsMutex);
+
+	free(block);
+}
+
+static void createKey() {
+	pthread_key_create(&statsKey, retireThread);
+}
+
+hkeyStats * hkeyStatsRegisterThread() {
+	static hkeyStats dummy;
+
+	hkeyStatsBlock * block = NULL;
+	size_t blockSize = (sizeof(hkeyStatsBlock) + HKEY_STATS_CACHE_LINE - 1) / HKEY_STATS_CACHE_LINE * HKEY_STATS_CACHE_LINE;
+
+	pthread_once(&statsOnce, createKey);
+
+	if(posix_memalign((void**)&block, HKEY_STATS_CACHE_LINE, blockSize) != 0) {
+		//counting is best effort, do not fail the calculation because of it
+		hkeyStatsLocal = &dummy;
+		return hkeyStatsLocal;
+	}
+	memset(block, 0, blockSize);
+
+	pthread_setspecific(statsKey, block);
+
+	pthread_mutex_lock(&statsMutex);
+	block->next = statsBlocks;
+	if(statsBlocks != NULL) {
+		statsBlocks->prev = block;
+	}
+	statsBlocks = block;
+	pthread_mutex_unlock(&statsMutex);
+
+	hkeyStatsLocal = &block->stats;
+	return hkeyStatsLocal;
+}
+
+double hkeyStatsTimerStart() {
+	struct timespec ts;
+
+	if(hkeyStatsHook == NULL) {
+		return 0.0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+void hkeyStatsTimerStop( const double start, const int op, const int32_t dim, const uint64_t num ) {
+	struct timespec ts;
+	hkeyStatsTimingHook hook = hkeyStatsHook;
+
+	//the hook might have been installed during the batch, there is no valid start time then
+	if(hook == NULL || start == 0.0) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	hook(op, dim, num, (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9 - start, hkeyStatsHookData);
+}
+
+int hkeyStatsEnabled() {
+	return 1;
+}
+
+void hkeyStatsSnapshot( hkeyStats * out ) {
+	memset(out, 0, sizeof(hkeyStats));
+
+	pthread_mutex_lock(&statsMutex);
+	addStats(out, &statsRetired);
+	for(hkeyStatsBlock * block = statsBlocks; block != NULL; block = block->next) {
+		addBlockStats(out, block);
+	}
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void hkeyStatsThreadSnapshot( hkeyStats * out ) {
+	memset(out, 0, sizeof(hkeyStats));
+
+	if(hkeyStatsLocal == NULL) {
+		return;
+	}
+
+	//the fallback block of a failed registration is not part of the list
+	hkeyStatsBlock * block = (hkeyStatsBlock*)pthread_getspecific(statsKey);
+	if(block == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&statsMutex);
+	addBlockStats(out, block);
+	pthread_mutex_unlock(&statsMutex);
+}
+
+//counters of live threads are never written by other threads, a reset only moves their baseline
+void hkeyStatsReset() {
+	pthread_mutex_lock(&statsMutex);
+	memset(&statsRetired, 0, sizeof(hkeyStats));
+	for(hkeyStatsBlock * block = statsBlocks; block != NULL; block = block->next) {
+		memcpy(&block->baseline, &block->stats, sizeof(hkeyStats));
+	}
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void hkeyStatsSetTimingHook( hkeyStatsTimingHook hook, void * userData ) {
+	hkeyStatsHookData = userData;
+	hkeyStatsHook = hook;
+}
+
+#else
+
+int hkeyStatsEnabled() {
+	return 0;
+}
+
+void hkeyStatsSnapshot( hkeyStats * out ) {
+	memset(out, 0, sizeof(hkeyStats));
+}
+
+void hkeyStatsThreadSnapshot( hkeyStats * out ) {
+	memset(out, 0, sizeof(hkeyStats));
+}
+
+void hkeyStatsReset() {
+}
+
+void hkeyStatsSetTimingHook( hkeyStatsTimingHook hook, void * userData ) {
+	(void)hook;
+	(void)userData;
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2013, Adrian M. Partl <apartl@aip.de>,
+ *                      eScience team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*! \file hilbertStats.h
+ \brief Optional statistics for the Hilbert key functions
+
+ Counters and timing hooks for the hot paths in hilbertKey.c. They are only collected
+ if the library is compiled with HKEY_STATS defined (cmake -DHKEY_STATS=ON). Otherwise
+ all counting macros expand to nothing and the snapshot functions return zeros.
+
+ Counters are kept per thread and summed up when a snapshot is taken. Counters of
+ threads that have terminated are kept in the totals.
+ */
+
+#include <stdint.h>
+#include "hilbertKey.h"
+
+#ifndef __CLASS_HILBSTATS__
+#define __CLASS_HILBSTATS__
+
+#define HKEY_STATS_OP_ENCODE 0
+#define HKEY_STATS_OP_DECODE 1
+#define HKEY_STATS_OP_COMPARE 2
+
+/*! \brief statistics counters
+
+ encodeCalls/decodeCalls/compareCalls count single point calls, batchEncodeCalls/
+ batchDecodeCalls/batchCompareCalls count calls to the batched functions. pointsEncoded/
+ keysDecoded/pairsCompared count the points processed by both. compareLevels counts the
+ hilbert levels walked by comparisons, equal points count as one level. clampedCoords counts coordinates
+ outside of [0, 2**m) that were clamped to 2**m - 1. kernelCalls[dim-1] counts the calls
+ that selected the gene tables of dimension dim.*/
+typedef struct {
+	uint64_t encodeCalls;
+	uint64_t decodeCalls;
+	uint64_t batchEncodeCalls;
+	uint64_t batchDecodeCalls;
+	uint64_t pointsEncoded;
+	uint64_t keysDecoded;
+	uint64_t compareCalls;
+	uint64_t batchCompareCalls;
+	uint64_t pairsCompared;
+	uint64_t compareLevels;
+	uint64_t clampedCoords;
+	uint64_t dimErrors;
+	uint64_t kernelCalls[HKEY_MAX_DIM];
+} hkeyStats;
+
+/*! \brief timing hook for batched calls
+ \param const int op:   			HKEY_STATS_OP_ENCODE, HKEY_STATS_OP_DECODE or HKEY_STATS_OP_COMPARE
+ \param const int32_t dim:   	number of dimensions
+ \param const uint64_t num:   	number of points/keys in the batch
+ \param const double seconds:   wall clock time spent in the batched call
+ \param void * userData:   		pointer passed to hkeyStatsSetTimingHook*/
+typedef void (*hkeyStatsTimingHook)( const int op, const int32_t dim, const uint64_t num, const double seconds, void * userData );
+
+/*! \brief returns 1 if the library was compiled with statistics, 0 otherwise*/
+int hkeyStatsEnabled();
+
+/*! \brief sum of the counters of all threads
+ \param hkeyStats * out:   		pre-allocated statistics structure
+
+ Counters of threads that are still running are read while they might be updated,
+ thus the snapshot is not an atomic view over all threads.*/
+void hkeyStatsSnapshot( hkeyStats * out );
+
+/*! \brief counters of the calling thread
+ \param hkeyStats * out:   		pre-allocated statistics structure*/
+void hkeyStatsThreadSnapshot( hkeyStats * out );
+
+/*! \brief reset the counters of all threads to zero
+
+ Counters of running threads are not modified, the reset records their current values
+ which are subtracted by later snapshots. Increments that happen during the reset are
+ either counted before or after it, none are lost.*/
+void hkeyStatsReset();
+
+/*! \brief install a timing hook for batched calls
+ \param hkeyStatsTimingHook hook: function called after every batched call, NULL disables timing
+ \param void * userData:   		pointer handed to the hook
+
+ The hook is called from the thread that executed the batch. Install it before
+ starting worker threads.*/
+void hkeyStatsSetTimingHook( hkeyStatsTimingHook hook, void * userData );
+
+#ifdef HKEY_STATS
+
+extern __thread hkeyStats * hkeyStatsLocal;
+extern hkeyStatsTimingHook hkeyStatsHook;
+
+hkeyStats * hkeyStatsRegisterThread();
+double hkeyStatsTimerStart();
+void hkeyStatsTimerStop( const double start, const int op, const int32_t dim, const uint64_t num );
+
+#define HKEY_STATS_ADD(field, n) ((hkeyStatsLocal != NULL ? hkeyStatsLocal : hkeyStatsRegisterThread())->field += (n))
+#define HKEY_STATS_TIMER_START(var) double var = hkeyStatsTimerStart()
+#define HKEY_STATS_TIMER_STOP(var, op, dim, num) hkeyStatsTimerStop(var, op, dim, num)
+
+#else
+
+#define HKEY_STATS_ADD(field, n)
+#define HKEY_STATS_TIMER_START(var)
+#define HKEY_STATS_TIMER_STOP(var, op, dim, num)
+
+#endif
+
+#endif